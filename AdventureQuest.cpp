@@ -1,96 +1,638 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <cstdlib>
 #include <ctime>
 #include <iomanip>
+#include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <charconv>
+#if defined(__unix__) || defined(__APPLE__)
+#define AQ_SHARED_MEMORY
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 using namespace std;
 #define RESET   "\033[0m"
 #define RED     "\033[31m"
 #define GREEN   "\033[32m"
 #define BLUE    "\033[34m"
+#define YELLOW  "\033[33m"
+#define MAGENTA "\033[35m"
+#define CYAN    "\033[36m"
 #define BOLD    "\033[1m"
+#ifdef AQ_COUNT_ALLOCATIONS
+#include <new>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+atomic<long long> heapAllocations(0);
+void* operator new(size_t size)
+{
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#endif
 class Item;
 class Helper;
 class Hurdle;
 class Player;
 class Board;
 class AdventureQuest;
+class StatePublisher;
+enum ItemKind
+{
+    KIND_GOLD,
+    KIND_SILVER,
+    KIND_SWORD,
+    KIND_SHIELD,
+    KIND_WATER,
+    KIND_KEY,
+    KIND_FIRE,
+    KIND_SNAKE,
+    KIND_GHOST,
+    KIND_LION,
+    KIND_LOCK,
+    KIND_COUNT
+};
+const int HELPER_KINDS = 4;
+const int HURDLE_KINDS = 5;
+const int PROMPT_CELL = -1;
+constexpr string_view ITEM_NAMES[KIND_COUNT + 1] = { "Gold", "Silver", "Sword", "Shield", "Water", "Key", "Fire", "Snake", "Ghost", "Lion", "Lock", "None" };
+constexpr string_view ITEM_SHORT_NAMES[KIND_COUNT + 1] = { "GLD", "SIL", "SWD", "SHD", "WTR", "KEY", "FIR", "SNK", "GST", "LIO", "LCK", "   " };
+struct HurdleRule
+{
+    int cost;
+    int goldCost;
+    int silverCost;
+    int penalty;
+    int blockTurns;
+    int pushBack;
+    ItemKind neutralizer;
+};
+struct HelperRule
+{
+    int cost;
+    int silverCost;
+    int uses;
+    bool clearsBlock;
+    const char* useMessage;
+};
+struct RuleSet
+{
+    HurdleRule hurdles[HURDLE_KINDS];
+    HelperRule helpers[HELPER_KINDS];
+    int startGold;
+    int startSilver;
+    int itemDensity;
+
+    constexpr const HurdleRule& hurdle(int kind) const { return hurdles[kind - KIND_FIRE]; }
+    constexpr const HelperRule& helper(int kind) const { return helpers[kind - KIND_SWORD]; }
+    int* field(const string& key);
+};
+constexpr RuleSet DEFAULT_RULES =
+{
+    {
+        { 50, 0, 0, 50, 2, 0, KIND_WATER },
+        { 30, 0, 0, 30, 3, 3, KIND_SWORD },
+        { 20, 0, 0, 20, 1, 0, KIND_SHIELD },
+        { 50, 1, 0, 50, 4, 0, KIND_SWORD },
+        { 0, 0, 12, 0, 99, 0, KIND_KEY }
+    },
+    {
+        { 40, 0, 2, false, "Used Sword to clear hurdle!" },
+        { 30, 0, 1, false, "Used Shield to clear hurdle!" },
+        { 50, 0, 1, false, "Used Water to clear hurdle!" },
+        { 0, 12, 1, true, "Used Key to unlock!" }
+    },
+    10,
+    20,
+    100
+};
+constexpr bool isHurdleKind(int kind) { return kind >= KIND_FIRE && kind < KIND_FIRE + HURDLE_KINDS; }
+constexpr bool isHelperKind(int kind) { return kind >= KIND_SWORD && kind < KIND_SWORD + HELPER_KINDS; }
+constexpr array<array<bool, HELPER_KINDS>, HURDLE_KINDS> makeNeutralizers()
+{
+    array<array<bool, HELPER_KINDS>, HURDLE_KINDS> table{};
+    for (int h = 0; h < HURDLE_KINDS; ++h)
+    {
+        table[h][DEFAULT_RULES.hurdles[h].neutralizer - KIND_SWORD] = true;
+    }
+    return table;
+}
+constexpr array<array<bool, HELPER_KINDS>, HURDLE_KINDS> NEUTRALIZES = makeNeutralizers();
+constexpr bool neutralizes(int helperKind, int hurdleKind)
+{
+    return isHelperKind(helperKind) && isHurdleKind(hurdleKind) && NEUTRALIZES[hurdleKind - KIND_FIRE][helperKind - KIND_SWORD];
+}
+static_assert(neutralizes(KIND_SWORD, KIND_SNAKE) && neutralizes(KIND_SWORD, KIND_LION) && !neutralizes(KIND_WATER, KIND_LOCK), "each hurdle must have exactly its documented helper");
+class Rng
+{
+private:
+    uint64_t state;
+
+public:
+    Rng(uint64_t seed) : state(seed) {}
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    int nextInt(int bound) { return static_cast<int>(next() % static_cast<uint64_t>(bound)); }
+    uint64_t getState() const { return state; }
+    void setState(uint64_t s) { state = s; }
+    static uint64_t mix(uint64_t seed, uint64_t stream) { return Rng(seed ^ (stream * 0xD1B54A32D192ED03ULL)).next(); }
+};
+class GameLog
+{
+private:
+    static thread_local bool quiet;
+
+public:
+    static ostream& out();
+    static bool isQuiet() { return quiet; }
+    static void setQuiet(bool q) { quiet = q; }
+};
+thread_local bool GameLog::quiet = false;
+ostream& GameLog::out()
+{
+    static thread_local ostream nullStream(nullptr);
+    return quiet ? nullStream : cout;
+}
+#ifdef AQ_TRACING
+class Tracer
+{
+private:
+    struct Event
+    {
+        const char* name;
+        int64_t start;
+        int64_t end;
+    };
+    struct Ring
+    {
+        static const int CAPACITY = 1 << 16;
+        Event events[CAPACITY];
+        atomic<uint64_t> written;
+        atomic<bool> inUse;
+        int thread;
+        Ring* next;
+    };
+    struct RingOwner
+    {
+        Ring* ring = nullptr;
+        ~RingOwner()
+        {
+            if (ring)
+            {
+                ring->inUse.store(false, memory_order_release);
+            }
+        }
+    };
+
+    static atomic<bool> enabled;
+    static atomic<Ring*> rings;
+    static atomic<int> threadCount;
+    static Ring& local();
+
+public:
+    static void enable(bool on) { enabled.store(on, memory_order_relaxed); }
+    static bool isEnabled() { return enabled.load(memory_order_relaxed); }
+    static int64_t now() { return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count(); }
+    static void record(const char* name, int64_t start, int64_t end);
+    static bool exportJson(const string& path, long long& events, long long& dropped, string& error);
+};
+atomic<bool> Tracer::enabled(false);
+atomic<Tracer::Ring*> Tracer::rings(nullptr);
+atomic<int> Tracer::threadCount(0);
+Tracer::Ring& Tracer::local()
+{
+    thread_local RingOwner owner;
+    if (owner.ring)
+    {
+        return *owner.ring;
+    }
+    for (Ring* ring = rings.load(memory_order_acquire); ring; ring = ring->next)
+    {
+        bool idle = false;
+        if (ring->inUse.compare_exchange_strong(idle, true, memory_order_acquire, memory_order_relaxed))
+        {
+            owner.ring = ring;
+            return *ring;
+        }
+    }
+    Ring* ring = new Ring;
+    ring->written.store(0, memory_order_relaxed);
+    ring->inUse.store(true, memory_order_relaxed);
+    ring->thread = threadCount.fetch_add(1, memory_order_relaxed) + 1;
+    ring->next = rings.load(memory_order_relaxed);
+    while (!rings.compare_exchange_weak(ring->next, ring, memory_order_release, memory_order_relaxed))
+    {
+    }
+    owner.ring = ring;
+    return *ring;
+}
+void Tracer::record(const char* name, int64_t start, int64_t end)
+{
+    Ring& ring = local();
+    uint64_t slot = ring.written.load(memory_order_relaxed);
+    ring.events[slot % Ring::CAPACITY] = { name, start, end };
+    ring.written.store(slot + 1, memory_order_release);
+}
+bool Tracer::exportJson(const string& path, long long& events, long long& dropped, string& error)
+{
+    ofstream out(path);
+    if (!out)
+    {
+        error = "Cannot open " + path + " for writing";
+        return false;
+    }
+    events = 0;
+    dropped = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    out << fixed << setprecision(3);
+    for (const Ring* ring = rings.load(memory_order_acquire); ring; ring = ring->next)
+    {
+        uint64_t written = ring->written.load(memory_order_acquire);
+        uint64_t first = written > static_cast<uint64_t>(Ring::CAPACITY) ? written - Ring::CAPACITY : 0;
+        dropped += static_cast<long long>(first);
+        for (uint64_t i = first; i < written; ++i)
+        {
+            const Event& event = ring->events[i % Ring::CAPACITY];
+            out << (events++ ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"aq\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->thread;
+            out << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out)
+    {
+        error = "Cannot write " + path;
+        return false;
+    }
+    return true;
+}
+class TraceSpan
+{
+private:
+    const char* name;
+    int64_t start;
+
+public:
+    TraceSpan(const char* name) : name(name), start(Tracer::isEnabled() ? Tracer::now() : -1) {}
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+    ~TraceSpan()
+    {
+        if (start >= 0)
+        {
+            Tracer::record(name, start, Tracer::now());
+        }
+    }
+};
+class TraceSession
+{
+private:
+    string path;
+
+public:
+    TraceSession(const string& path) : path(path) { Tracer::enable(!path.empty()); }
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+    ~TraceSession()
+    {
+        if (path.empty())
+        {
+            return;
+        }
+        Tracer::enable(false);
+        long long events;
+        long long dropped;
+        string error;
+        if (Tracer::exportJson(path, events, dropped, error))
+        {
+            cerr << "Trace: " << events << " spans (" << dropped << " overwritten) -> " << path << endl;
+        }
+        else
+        {
+            cerr << error << "!" << endl;
+        }
+    }
+};
+#define AQ_TRACE_JOIN(a, b) a##b
+#define AQ_TRACE_NAME(line) AQ_TRACE_JOIN(traceSpan, line)
+#define AQ_TRACE_SPAN(name) TraceSpan AQ_TRACE_NAME(__LINE__)(name)
+#else
+#define AQ_TRACE_SPAN(name) ((void)0)
+#endif
+template <typename T>
+void readInput(T& value)
+{
+    AQ_TRACE_SPAN("input");
+    cin >> value;
+}
+void readLine(string& line)
+{
+    AQ_TRACE_SPAN("input");
+    getline(cin >> ws, line);
+}
 class Item
 {
 protected:
-    string name;
-    int X, Y;
+    ItemKind kind;
 
 public:
-    Item(int x, int y) : X(x), Y(y) {}
+    Item(ItemKind k) : kind(k) {}
     virtual ~Item() {}
     virtual void interact(Player& player) = 0;
     virtual Item* clone() const = 0;
-    string getName() const { return name; }
-    virtual string getShortName() const { return name.substr(0, 3); }
-    int getX() const { return X; }
-    int getY() const { return Y; }
+    string_view getName() const { return ITEM_NAMES[kind]; }
+    ItemKind getKind() const { return kind; }
+    string_view getShortName() const { return ITEM_SHORT_NAMES[kind]; }
+};
+inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    int count = 0;
+    for (; x; x &= x - 1)
+    {
+        count++;
+    }
+    return count;
+#endif
+}
+inline int lowestBit(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int index = 0;
+    while (!(x & 1))
+    {
+        x >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+class BitBoard
+{
+private:
+    uint64_t low;
+    uint64_t high;
+
+    static BitBoard below(int num);
+
+public:
+    BitBoard() : low(0), high(0) {}
+    BitBoard(uint64_t l, uint64_t h) : low(l), high(h) {}
+    static BitBoard cell(int num) { return num < 64 ? BitBoard(1ULL << num, 0) : BitBoard(0, 1ULL << (num - 64)); }
+    static BitBoard range(int first, int last);
+    bool test(int num) const { return ((num < 64 ? low >> num : high >> (num - 64)) & 1) != 0; }
+    void set(int num) { *this |= cell(num); }
+    void reset(int num) { *this &= ~cell(num); }
+    bool any() const { return (low | high) != 0; }
+    int count() const { return popcount64(low) + popcount64(high); }
+    int takeLowest()
+    {
+        if (low)
+        {
+            int num = lowestBit(low);
+            low &= low - 1;
+            return num;
+        }
+        int num = 64 + lowestBit(high);
+        high &= high - 1;
+        return num;
+    }
+    BitBoard operator|(const BitBoard& o) const { return BitBoard(low | o.low, high | o.high); }
+    BitBoard operator&(const BitBoard& o) const { return BitBoard(low & o.low, high & o.high); }
+    BitBoard operator~() const { return BitBoard(~low, ~high); }
+    BitBoard& operator|=(const BitBoard& o) { low |= o.low; high |= o.high; return *this; }
+    BitBoard& operator&=(const BitBoard& o) { low &= o.low; high &= o.high; return *this; }
+    bool operator==(const BitBoard& o) const { return low == o.low && high == o.high; }
+    uint64_t lowWord() const { return low; }
+    uint64_t highWord() const { return high; }
+};
+template <int N>
+constexpr array<int8_t, N * N + 1> makeNumberToX()
+{
+    array<int8_t, N * N + 1> table{};
+    for (int num = 1; num <= N * N; ++num)
+    {
+        table[num] = static_cast<int8_t>((num - 1) / N);
+    }
+    return table;
+}
+template <int N>
+constexpr array<int8_t, N * N + 1> makeNumberToY()
+{
+    array<int8_t, N * N + 1> table{};
+    for (int num = 1; num <= N * N; ++num)
+    {
+        int row = (num - 1) / N;
+        int offset = (num - 1) % N;
+        table[num] = static_cast<int8_t>(row % 2 == 0 ? offset : N - 1 - offset);
+    }
+    return table;
+}
+template <int N>
+constexpr array<uint8_t, N * N> makeCellNumbers()
+{
+    array<uint8_t, N * N> table{};
+    for (int x = 0; x < N; ++x)
+    {
+        for (int y = 0; y < N; ++y)
+        {
+            table[x * N + y] = static_cast<uint8_t>(x * N + (x % 2 == 0 ? y : N - 1 - y) + 1);
+        }
+    }
+    return table;
+}
+template <int N>
+struct Serpentine
+{
+    static constexpr int CELLS = N * N;
+    static constexpr int GOAL = (CELLS + 1) / 2;
+    static constexpr array<int8_t, CELLS + 1> numberToX = makeNumberToX<N>();
+    static constexpr array<int8_t, CELLS + 1> numberToY = makeNumberToY<N>();
+    static constexpr array<uint8_t, CELLS> cellNumbers = makeCellNumbers<N>();
 };
+static_assert(Serpentine<5>::cellNumbers[1 * 5 + 0] == 10 && Serpentine<5>::numberToY[10] == 0, "serpentine rows must alternate direction");
+static_assert(Serpentine<11>::numberToX[Serpentine<11>::GOAL] == 5 && Serpentine<11>::numberToY[Serpentine<11>::GOAL] == 5, "goal must be the centre cell");
 class Board
 {
 private:
+    struct Layout
+    {
+        int size;
+        const int8_t* numberToX;
+        const int8_t* numberToY;
+        const uint8_t* cellNumbers;
+        void (Board::*print)(const Player*, int) const;
+        void (Board::*initializeItems)();
+    };
+    static const int BOARD_KINDS = 7;
     int size;
     int level;
-    Item*** cells;
-    bool** player1Path;
-    bool** player2Path;
-    int** cellNumbers;
-    int* numberToPosX;
-    int* numberToPosY;
+    uint64_t seed;
+    int itemDensity;
+    const Layout* layout;
+    array<BitBoard, BOARD_KINDS> items;
+
+    static int slotOf(ItemKind kind) { return kind <= KIND_SILVER ? kind : kind - KIND_FIRE + 2; }
+    static ItemKind kindOfSlot(int slot) { return slot < 2 ? static_cast<ItemKind>(slot) : static_cast<ItemKind>(slot - 2 + KIND_FIRE); }
+    template <int N> static const Layout& layoutFor();
+    template <int N> void printCells(const Player* players, int playerCount) const;
+    template <int N> void placeInitialItems();
+    void selectLayout(int level);
 
 public:
     Board(int level);
-    Board(const Board& other);
-    Board& operator=(const Board& other);
-    ~Board();
+    Board(int level, uint64_t seed, int itemDensity = DEFAULT_RULES.itemDensity);
+    void reset(int level, uint64_t seed);
+    void load(int level, uint64_t seed, const BitBoard* masks);
     void initializeItems();
-    void print(const Player* player1, const Player* player2) const;
-    void markPlayerPath(int x, int y, bool isPlayer1);
+    void print(const Player* players, int playerCount) const;
     int getSize() const { return size; }
-    Item* getItem(int x, int y) const { return cells[x][y]; }
-    void setItem(int x, int y, Item* item) { cells[x][y] = item; }
+    Item* getItem(int x, int y) const;
+    ItemKind getKind(int num) const;
+    void setKind(int num, ItemKind kind);
+    void clearCell(int num);
+    bool isEmpty(int num) const { return !occupiedMask().test(num); }
+    BitBoard getMask(ItemKind kind) const { return items[slotOf(kind)]; }
+    BitBoard occupiedMask() const;
+    BitBoard coinMask() const { return items[slotOf(KIND_GOLD)] | items[slotOf(KIND_SILVER)]; }
+    BitBoard hurdleMask() const;
+    int coinsRemaining() const { return coinMask().count(); }
+    bool hurdleWithin(int fromNum, int k, int direction) const;
+    int countBetween(ItemKind kind, int first, int last) const;
+    int coinValueBetween(int first, int last) const;
+    int hurdleCostBetween(int first, int last, const RuleSet& rules) const;
+    static Item* prototype(ItemKind kind);
     pair<int, int> numberToPosition(int num) const;
     int positionToNumber(int x, int y) const;
     int getLevel() const { return level; }
+    uint64_t getSeed() const { return seed; }
 
     friend class Player;
     friend class AdventureQuest;
+    friend class BatchEngine;
+    friend class BoardPack;
+};
+class MoveHistory
+{
+private:
+    static const int CHUNK = 32;
+    struct Node
+    {
+        Node* parent;
+        int parentUsed;
+        int refs;
+        int count;
+        int base;
+        int8_t deltas[CHUNK - 1];
+    };
+
+    Node* head;
+    Node* spare;
+    int used;
+    int length;
+    int last;
+
+    static int valueAt(const Node* node, int index);
+    Node* allocate();
+    void release(Node* node);
+
+public:
+    MoveHistory() : head(nullptr), spare(nullptr), used(0), length(0), last(0) {}
+    MoveHistory(const MoveHistory& other);
+    MoveHistory(MoveHistory&& other) noexcept;
+    MoveHistory& operator=(const MoveHistory& other);
+    MoveHistory& operator=(MoveHistory&& other) noexcept;
+    ~MoveHistory();
+    void reserve(int moves);
+    void push(int num);
+    void pop(int moves);
+    int peek(int depth) const;
+    void clear();
+    int size() const { return length; }
+    void copyTo(int* out) const;
+};
+class Helper : public Item
+{
+protected:
+    int uses;
+
+public:
+    Helper(ItemKind k = KIND_SWORD);
+    Helper(ItemKind k, int uses) : Item(k), uses(uses) {}
+    void interact(Player& player) override;
+    Item* clone() const override;
+    void use(Player& player) const;
+    bool canUseOn(int hurdleKind) const { return neutralizes(kind, hurdleKind); }
+    int getUses() const;
+    virtual ~Helper();
+    void decrementUse();
 };
 class Player
 {
 private:
+    static constexpr int INVENTORY_CAPACITY = 10;
     int X, Y;
     int currentNumber;
     int gold, silver;
     int points;
-    Item** inventory;
+    Helper inventory[INVENTORY_CAPACITY];
     Board* board;
     int invSize;
-    int invCapacity;
     int blockedTurns;
-    static const int MAX_HISTORY = 100;
-    int moveHistory[MAX_HISTORY];
-    int historyCount;
-    int historyStart;
+    MoveHistory history;
     int currentLevel;
     bool hasReachedGoal;
+    int seat;
+    int direction;
+    BitBoard path;
+    const RuleSet* rules;
 
-    bool checkInventory(const string& itemName) const;
+    int findHelper(ItemKind kind) const;
     void removeFromInventory(int index);
 
+    Player() : X(0), Y(0), currentNumber(0), gold(0), silver(0), points(0), board(nullptr), invSize(0), blockedTurns(0), currentLevel(1), hasReachedGoal(false), seat(0), direction(1), rules(&DEFAULT_RULES) {}
+
 public:
-    Player(int startNum, Board* b, int level);
-    Player(const Player& other);
-    Player& operator=(const Player& other);
-    ~Player();
+    Player(int seat, int startNum, int direction, Board* b, int level, const RuleSet* rules = &DEFAULT_RULES);
     void addGold(int g);
     void addSilver(int s);
-    void addItem(Item* item);
+    void addItem(const Helper& helper);
     void block(int turns);
     bool isBlocked() const { return blockedTurns > 0; }
     void unblock();
@@ -102,470 +644,1072 @@ public:
     int getSilver() const;
     void deductGold(int amount);
     void deductSilver(int amount);
-    bool hasWater() const;
-    bool hasSword() const;
-    bool hasShield() const;
-    bool hasKey() const;
-    void useWater();
-    void useSword();
-    void useShield();
-    void useKey();
+    bool hasHelper(ItemKind kind) const { return findHelper(kind) >= 0; }
+    bool useHelper(ItemKind kind);
     void recordMove(int num);
     void moveBack(int cells);
     void levelUp(int startNum);
-    void placeHurdle(Item* hurdle);
-    string getCurrentHurdle() const;
+    void restart(int startNum, int level);
+    void enterBoard(Board* b, int startNum, int direction);
+    int placeHurdle(const Item* hurdle, int placeNum = PROMPT_CELL);
+    ItemKind getCurrentHurdle() const;
     void clearHurdle();
     void displayInventory() const;
     bool useItem(int index);
     int getX() const { return X; }
     int getY() const { return Y; }
     int getCurrentNumber() const { return currentNumber; }
+    int getSeat() const { return seat; }
+    int getDirection() const { return direction; }
+    const BitBoard& getPath() const { return path; }
+    const RuleSet& getRules() const { return *rules; }
+    int getAssetValue() const { return points + gold * 10 + silver * 5; }
+    int getBlockedTurns() const { return blockedTurns; }
+    int getInventorySize() const { return invSize; }
+    int getInventoryCapacity() const { return INVENTORY_CAPACITY; }
+    const Helper* getInventoryItem(int index) const { return index >= 0 && index < invSize ? &inventory[index] : nullptr; }
     void setPosition(int num);
     bool hasReachedGoalState() const { return hasReachedGoal; }
     void setReachedGoal(bool reached) { hasReachedGoal = reached; }
 
     friend class Board;
     friend class AdventureQuest;
+    friend class BatchEngine;
+    friend class World;
 };
 class GoldCoin : public Item
 {
 public:
-    GoldCoin(int x, int y);
+    GoldCoin();
     void interact(Player& player) override;
     Item* clone() const override;
-    string getShortName() const override { return "GLD"; }
 };
 class SilverCoin : public Item
 {
 public:
-    SilverCoin(int x, int y);
+    SilverCoin();
     void interact(Player& player) override;
     Item* clone() const override;
-    string getShortName() const override { return "SIL"; }
 };
-class Helper : public Item
+class Hurdle : public Item
 {
-protected:
-    int cost;
-    int uses;
-
 public:
-    Helper(int x, int y, int c, int u);
-    virtual void use(Player& player) = 0;
-    virtual bool canUseOn(const string& hurdleType) const = 0;
-    int getCost() const;
-    int getUses() const;
-    virtual ~Helper();
-    void decrementUse();
+    Hurdle(ItemKind k);
+    void applyEffect(Player& player) const;
+    virtual void interact(Player& player) override;
+    int place(Player& player, int cell) const;
+    virtual ~Hurdle();
 };
-class Sword : public Helper
+class Fire : public Hurdle
 {
 public:
-    Sword(int x, int y);
+    Fire();
     void interact(Player& player) override;
-    void use(Player& player) override;
-    bool canUseOn(const string& hurdleType) const override;
     Item* clone() const override;
-    string getShortName() const override { return "SWD"; }
 };
-class Shield : public Helper
+class Snake : public Hurdle
 {
 public:
-    Shield(int x, int y);
+    Snake();
     void interact(Player& player) override;
-    void use(Player& player) override;
-    bool canUseOn(const string& hurdleType) const override;
     Item* clone() const override;
-    string getShortName() const override { return "SHD"; }
 };
-class Water : public Helper
+class Ghost : public Hurdle
 {
 public:
-    Water(int x, int y);
+    Ghost();
     void interact(Player& player) override;
-    void use(Player& player) override;
-    bool canUseOn(const string& hurdleType) const override;
     Item* clone() const override;
-    string getShortName() const override { return "WTR"; }
 };
-class Key : public Helper
+class Lion : public Hurdle
 {
 public:
-    Key(int x, int y);
+    Lion();
     void interact(Player& player) override;
-    void use(Player& player) override;
-    bool canUseOn(const string& hurdleType) const override;
     Item* clone() const override;
-    string getShortName() const override { return "KEY"; }
-};
-class Hurdle : public Item
-{
-protected:
-    int cost;
-    int penalty;
-    int blockTurns;
-
-public:
-    Hurdle(int x, int y, int c, int p, int turns);
-    virtual void applyEffect(Player& player) = 0;
-    virtual void interact(Player& player) override;
-    int getCost() const;
-    int getPenalty() const;
-    int getBlockTurns() const { return blockTurns; }
-    virtual ~Hurdle();
 };
-class Fire : public Hurdle
+class Lock : public Hurdle
 {
 public:
-    Fire(int x, int y);
+    Lock();
     void interact(Player& player) override;
-    void applyEffect(Player& player) override;
     Item* clone() const override;
-    string getShortName() const override { return "FIR"; }
 };
-class Snake : public Hurdle
+enum ActionType
+{
+    ACTION_NONE,
+    ACTION_MOVE,
+    ACTION_PLACE_HURDLE,
+    ACTION_BUY_HELPER,
+    ACTION_USE_ITEM,
+    ACTION_QUEUE
+};
+struct TurnAction
+{
+    int type;
+    int choice;
+    int cell;
+};
+class ActionQueue
 {
 public:
-    Snake(int x, int y);
-    void interact(Player& player) override;
-    void applyEffect(Player& player) override;
-    Item* clone() const override;
-    string getShortName() const override { return "SNK"; }
+    static constexpr int CAPACITY = 32;
+
+private:
+    TurnAction actions[CAPACITY];
+    int head;
+    int count;
+
+public:
+    ActionQueue() : head(0), count(0) {}
+    bool push(const TurnAction& action);
+    bool pop(TurnAction& action);
+    void clear() { head = 0; count = 0; }
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    bool parse(const string& script, string& error);
+    static string describe(const TurnAction& action);
 };
-class Ghost : public Hurdle
+class GameObserver
 {
 public:
-    Ghost(int x, int y);
-    void interact(Player& player) override;
-    void applyEffect(Player& player) override;
-    Item* clone() const override;
-    string getShortName() const override { return "GST"; }
+    virtual ~GameObserver() {}
+    virtual void onGameStart(const AdventureQuest& /*game*/) {}
+    virtual void onHurdlePlaced(int /*seat*/, ItemKind /*kind*/, int /*cell*/, int /*spent*/) {}
+    virtual void onHurdleHit(int /*seat*/, const Hurdle& /*hurdle*/, int /*cell*/, int /*pointsLost*/, int /*blockedTurns*/, bool /*neutralized*/) {}
+    virtual void onHelperBought(int /*seat*/, ItemKind /*kind*/, int /*spent*/) {}
+    virtual void onHelperUsed(int /*seat*/, ItemKind /*kind*/, ItemKind /*hurdleKind*/) {}
+    virtual void onGoalReached(int /*seat*/, int /*round*/) {}
+    virtual void onTurnsSkipped(int /*seat*/, int /*turns*/) {}
+    virtual void onGameEnd(const AdventureQuest& /*game*/, int /*winner*/, bool /*finished*/) {}
 };
-class Lion : public Hurdle
+class Bot
 {
 public:
-    Lion(int x, int y);
-    void interact(Player& player) override;
-    void applyEffect(Player& player) override;
-    Item* clone() const override;
-    string getShortName() const override { return "LIO"; }
+    virtual ~Bot() {}
+    virtual TurnAction chooseAction(const AdventureQuest& game, int seat) = 0;
 };
-class Lock : public Hurdle
+class TurnScheduler
 {
+private:
+    int playerCount;
+    uint64_t finished;
+    uint64_t sleeping;
+    int nextWake;
+    int wakeRound[64];
+
 public:
-    Lock(int x, int y);
-    void interact(Player& player) override;
-    void applyEffect(Player& player) override;
-    Item* clone() const override;
-    string getShortName() const override { return "LCK"; }
+    TurnScheduler(int playerCount) : playerCount(playerCount), finished(0), sleeping(0), nextWake(INT32_MAX) {}
+    uint64_t allSeats() const { return playerCount == 64 ? ~0ULL : (1ULL << playerCount) - 1; }
+    uint64_t pendingSeats() const { return allSeats() & ~finished; }
+    uint64_t actionableSeats() const { return pendingSeats() & ~sleeping; }
+    uint64_t sleepingSeats() const { return sleeping; }
+    bool allFinished() const { return pendingSeats() == 0; }
+    void markFinished(int seat) { finished |= 1ULL << seat; }
+    void reset(const Player* players);
+    void sleep(int seat, int round);
+    uint64_t wake(int round);
+    void clearSleeping() { sleeping = 0; nextWake = INT32_MAX; }
+    int getNextWake() const { return nextWake; }
+    int getWakeRound(int seat) const { return wakeRound[seat]; }
+    static int takeNext(uint64_t& seats)
+    {
+        int seat = lowestBit(seats);
+        seats &= seats - 1;
+        return seat;
+    }
 };
+inline bool isCellOccupied(const uint8_t* occupancy, int num, int goalNumber)
+{
+    return occupancy[num] > 0 && num != goalNumber;
+}
+const Hurdle* movePlayer(Player& player, Board& board, uint8_t* occupancy, int goalNumber);
 class AdventureQuest
 {
+public:
+    static constexpr int MAX_PLAYERS = 64;
+
 private:
-    Board* board;
-    Player* player1;
-    Player* player2;
+    unique_ptr<Board> board;
+    unique_ptr<Player[]> players;
+    int playerCount;
     int currentLevel;
-    AdventureQuest* savedState;
+    unique_ptr<AdventureQuest> savedState;
+    unique_ptr<AdventureQuest> spareState;
     int goalNumber;
-    bool player1ReachedFirst;
-    bool player2ReachedFirst;
+    uint64_t seed;
+    int roundNumber;
+    int roundSeat;
+    GameObserver* observer;
+    StatePublisher* publisher;
+    TurnScheduler scheduler;
+    uint8_t occupancy[11 * 11 + 1];
+    future<unique_ptr<Board>> nextBoard;
+    const RuleSet* rules;
+    unique_ptr<ActionQueue[]> queues;
+
+    bool skipTurn(int seat);
+    void queueActions(int seat);
+    void playQueuedTurn(int seat);
+    bool runQueuedAction(int seat);
+    void cancelQueue(int seat, const char* reason);
+    bool hasQueuedActions() const;
+    void sleepIfBlocked(int seat);
+    void wakeSeats();
+    void settleBlocked();
+    void rebuildOccupancy();
+    void copyPlayers(const AdventureQuest& other);
+    void prefetchNextLevel();
+    unique_ptr<Board> takeNextBoard();
+    void discardNextBoard();
+    void discardSavedGame();
+    void publish();
+    void restartPlayers();
 
 public:
     AdventureQuest();
+    AdventureQuest(int level, uint64_t seed, int playerCount = 2, const RuleSet* rules = &DEFAULT_RULES);
+    // Copies start without an observer or publisher; moves take both over and leave the source detached.
     AdventureQuest(const AdventureQuest& other);
+    AdventureQuest(AdventureQuest&& other) noexcept;
     AdventureQuest& operator=(const AdventureQuest& other);
-    ~AdventureQuest();
+    AdventureQuest& operator=(AdventureQuest&& other) noexcept;
+    static int maxPlayersFor(int totalCells) { return min(MAX_PLAYERS, 2 * ((totalCells + 1) / 2 - 1)); }
+    static int startCell(int seat, int playerCount, int totalCells);
+    static int startDirection(int seat) { return seat % 2 == 0 ? -1 : 1; }
     void saveGame();
     void loadGame();
-    void playTurn(Player* player, Player* opponent, bool isPlayer1);
+    void playTurn(int seat);
+    bool queueScript(int seat, const string& script, string& error);
+    int getQueuedCount(int seat) const { return queues ? queues[seat].size() : 0; }
+    void applyAction(int seat, const TurnAction& action);
+    void stepTurn(int seat, const TurnAction& action);
+    void replayTurn(int turn, const TurnAction& action);
+    void writeState(string& out) const;
+    bool readState(const char* data, size_t size);
+    const char* checkInvariants() const;
+    const char* checkInvariants(uint64_t seats) const;
     void startGame();
+    int runSimulation(Bot* const* bots, int maxRounds);
+    int runSimulation(Bot& bot, int maxRounds);
+    int getWinner() const;
     void determineWinner();
     void levelUp();
+    void restart(int level, uint64_t seed);
+    void restart(const Board& start);
+    uint64_t levelSeed(int level) const { return Rng::mix(seed, static_cast<uint64_t>(level)); }
+    void setObserver(GameObserver* o) { observer = o; }
+    void setPublisher(StatePublisher* p) { publisher = p; }
     int getBoardLevel() const { return board->getLevel(); }
+    const Board& getBoard() const { return *board; }
+    const RuleSet& getRules() const { return *rules; }
+    int getPlayerCount() const { return playerCount; }
+    const Player& getPlayer(int seat) const { return players[seat]; }
+    bool isOccupied(int num) const { return isCellOccupied(occupancy, num, goalNumber); }
+    bool isFinished() const { return scheduler.allFinished(); }
+    int getGoalNumber() const { return goalNumber; }
+    int coinValueAhead(int seat) const;
+    int hurdleCostAhead(int seat) const;
+    int closestOpponent(int seat) const;
+    int getRound() const { return roundNumber; }
+    void beginRound() { roundNumber++; }
+    int getBlockedTurns(int seat) const;
+    uint64_t getSeed() const { return seed; }
+    void reserveHistory(int moves);
+
+    friend class BatchEngine;
 };
-Board::Board(int level) : level(level)
+static_assert(is_nothrow_move_constructible<Player>::value && is_nothrow_move_assignable<Player>::value, "players must move without cloning");
+static_assert(is_nothrow_move_constructible<AdventureQuest>::value && is_nothrow_move_assignable<AdventureQuest>::value, "games must move without cloning");
+class RandomBot : public Bot
 {
-    if (level == 1)
-    {
-        size = 5;
-    }
-    else if (level == 2)
-    {
-        size = 7;
-    }
-    else if (level == 3)
-    {
-        size = 9;
-    }
-    else
-    {
-        size = 11;
-    }
-
-    cells = new Item * *[size];
-    player1Path = new bool* [size];
-    player2Path = new bool* [size];
-    cellNumbers = new int* [size];
-    for (int i = 0; i < size; ++i)
-    {
-        cells[i] = new Item * [size];
-        player1Path[i] = new bool[size];
-        player2Path[i] = new bool[size];
-        cellNumbers[i] = new int[size];
-        for (int j = 0; j < size; ++j)
-        {
-            cells[i][j] = nullptr;
-            player1Path[i][j] = false;
-            player2Path[i][j] = false;
-        }
-    }
+private:
+    Rng rng;
+    int hurdleRate;
+    int helperRate;
 
-    int totalCells = size * size;
-    numberToPosX = new int[totalCells + 1];
-    numberToPosY = new int[totalCells + 1];
-    int num = 1;
-    for (int i = 0; i < size; ++i)
-    {
-        if (i % 2 == 0)
-        {
-            for (int j = 0; j < size; ++j)
-            {
-                cellNumbers[i][j] = num;
-                numberToPosX[num] = i;
-                numberToPosY[num] = j;
-                num++;
-            }
-        }
-        else
-        {
-            for (int j = size - 1; j >= 0; --j)
-            {
-                cellNumbers[i][j] = num;
-                numberToPosX[num] = i;
-                numberToPosY[num] = j;
-                num++;
-            }
-        }
+public:
+    RandomBot(uint64_t seed, int hurdleRate = 8, int helperRate = 6);
+    TurnAction chooseAction(const AdventureQuest& game, int seat) override;
+};
+class MoveBot : public Bot
+{
+public:
+    TurnAction chooseAction(const AdventureQuest& game, int seat) override;
+};
+enum PolicyGeneIndex
+{
+    GENE_HURDLE_RATE,
+    GENE_HURDLE_RESERVE,
+    GENE_AHEAD_MIN,
+    GENE_AHEAD_MAX,
+    GENE_HURDLE_WEIGHT,
+    GENE_HELPER_RATE = GENE_HURDLE_WEIGHT + HURDLE_KINDS,
+    GENE_HELPER_RESERVE,
+    GENE_LOOKAHEAD,
+    GENE_HELPER_WEIGHT,
+    GENE_MAX_HELPERS = GENE_HELPER_WEIGHT + HELPER_KINDS,
+    POLICY_GENES
+};
+struct PolicyGene
+{
+    const char* name;
+    int lo;
+    int hi;
+};
+constexpr PolicyGene POLICY_GENE_RANGES[POLICY_GENES] =
+{
+    { "hurdle_rate", 0, 100 },
+    { "hurdle_reserve", 0, 200 },
+    { "ahead_min", 1, 8 },
+    { "ahead_max", 1, 8 },
+    { "fire_weight", 0, 10 },
+    { "snake_weight", 0, 10 },
+    { "ghost_weight", 0, 10 },
+    { "lion_weight", 0, 10 },
+    { "lock_weight", 0, 10 },
+    { "helper_rate", 0, 100 },
+    { "helper_reserve", 0, 200 },
+    { "lookahead", 0, 8 },
+    { "sword_weight", 0, 10 },
+    { "shield_weight", 0, 10 },
+    { "water_weight", 0, 10 },
+    { "key_weight", 0, 10 },
+    { "max_helpers", 0, 10 }
+};
+struct Policy
+{
+    int genes[POLICY_GENES];
+};
+constexpr Policy EVOLVED_POLICY = { { 93, 0, 1, 4, 0, 6, 0, 0, 3, 6, 152, 3, 1, 9, 8, 5, 6 } };
+class PolicyBot : public Bot
+{
+private:
+    Policy policy;
+    Rng rng;
+
+    int pickWeighted(const int* weights, const bool* allowed, int count);
+    TurnAction chooseHurdle(const AdventureQuest& game, int seat);
+    TurnAction chooseHelper(const AdventureQuest& game, int seat);
+
+public:
+    PolicyBot(const Policy& policy, uint64_t seed) : policy(policy), rng(seed) {}
+    TurnAction chooseAction(const AdventureQuest& game, int seat) override;
+};
+class SearchBot : public Bot
+{
+private:
+    static const int MAX_ACTIONS = 32;
+    static const int WIN_SCORE = 1000000;
+    static const int DISTANCE_WEIGHT = 12;
+    static const int BLOCK_WEIGHT = 15;
+    static const int HELPER_WEIGHT = 10;
+    static const int GOAL_BONUS = 100;
+
+    int budgetMs;
+    int maxDepth;
+    int rootSeat;
+    bool timedOut;
+    long long nodes;
+    int lastDepth;
+    chrono::steady_clock::time_point deadline;
+
+    int candidateActions(const AdventureQuest& game, int seat, TurnAction* actions) const;
+    static int nextSeat(const AdventureQuest& game, int seat);
+    static int playerValue(const AdventureQuest& game, int seat);
+    int evaluate(const AdventureQuest& game) const;
+    int search(const AdventureQuest& game, int seat, int depth, int alpha, int beta);
+
+public:
+    SearchBot(int budgetMs = 20, int maxDepth = 32) : budgetMs(budgetMs), maxDepth(maxDepth), rootSeat(0), timedOut(false), nodes(0), lastDepth(0) {}
+    TurnAction chooseAction(const AdventureQuest& game, int seat) override;
+    int getLastDepth() const { return lastDepth; }
+    long long getNodes() const { return nodes; }
+};
+class StrategySearch
+{
+private:
+    int populationSize;
+    Policy* population;
+    double* fitness;
+    int generation;
+    uint64_t seed;
+    long long games;
+    int level;
+    int maxRounds;
+    Rng rng;
+
+    void randomize(Policy& policy);
+    const Policy& tournament();
+    void mutate(Policy& policy);
+
+public:
+    StrategySearch(int populationSize, uint64_t seed, long long games, int level, int maxRounds);
+    StrategySearch(const StrategySearch&) = delete;
+    StrategySearch& operator=(const StrategySearch&) = delete;
+    ~StrategySearch();
+    void evaluate(int threads);
+    void breed(int elites);
+    int best() const;
+    int getGeneration() const { return generation; }
+    const Policy& getPolicy(int index) const { return population[index]; }
+    double getFitness(int index) const { return fitness[index]; }
+    bool saveCheckpoint(const string& path) const;
+    bool loadCheckpoint(const string& path, string& error);
+    static bool exportPolicy(const string& path, const Policy& policy, double fitness);
+};
+class BatchEngine
+{
+private:
+    static const int32_t EMPTY_CELL = KIND_COUNT;
+
+    int gameCount;
+    int lanes;
+    int totalCells;
+    int goalNumber;
+    int32_t* cellKind;
+    int32_t* active;
+    int32_t* rounds;
+    int32_t* position[2];
+    int32_t* points[2];
+    int32_t* gold[2];
+    int32_t* silver[2];
+    int32_t* blocked[2];
+    int32_t* reached[2];
+    int32_t* helpers[2][HELPER_KINDS];
+    MoveHistory* history;
+    int32_t* activeBlocks;
+    int activeBlockCount;
+    const RuleSet* rules;
+
+    void stepLane(int seat, int g);
+    void stepSeat(int seat);
+    void recordMove(int seat, int g, int num);
+    void collect(int seat, int g, int num);
+    void applyHurdle(int seat, int g, int kind);
+    void moveBack(int seat, int g, int cells);
+    void updateActive(int maxRounds);
+
+public:
+    BatchEngine(int gameCount, int level, const RuleSet* rules = &DEFAULT_RULES);
+    BatchEngine(const BatchEngine&) = delete;
+    BatchEngine& operator=(const BatchEngine&) = delete;
+    ~BatchEngine();
+    void load(int g, const AdventureQuest& game);
+    void run(int maxRounds);
+    bool matches(int g, const AdventureQuest& game) const;
+    int getWinner(int g) const;
+    static bool usesAvx2();
+};
+class RunningStat
+{
+private:
+    long long count;
+    double mean;
+    double m2;
+
+public:
+    RunningStat() : count(0), mean(0.0), m2(0.0) {}
+    void add(double x);
+    long long getCount() const { return count; }
+    double getMean() const { return mean; }
+    double getVariance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+    double getHalfWidth95() const { return count > 1 ? 1.96 * sqrt(getVariance() / count) : 0.0; }
+};
+class ColumnarWriter
+{
+private:
+    ofstream file;
+    int columnCount;
+    int blockRows;
+    int64_t* buffer;
+    int rowsInBlock;
+    long long totalRows;
+
+    void flushBlock();
+
+public:
+    ColumnarWriter(const string& path, const char* const* columnNames, int columnCount, int blockRows = 4096);
+    ColumnarWriter(const ColumnarWriter&) = delete;
+    ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+    ~ColumnarWriter();
+    bool isOpen() const { return file.is_open(); }
+    void writeRow(const int64_t* values);
+    void close();
+};
+class BalanceAnalytics : public GameObserver
+{
+private:
+    static const int MAX_CELLS = 11 * 11;
+    static constexpr int MAX_SEATS = AdventureQuest::MAX_PLAYERS;
+    static const int GAME_COLUMNS = 7;
+    static const int SEAT_COLUMNS = 2;
+    static const int MAX_COLUMNS = GAME_COLUMNS + SEAT_COLUMNS * MAX_SEATS;
+
+    ColumnarWriter* columns;
+    int seatColumns;
+    const RuleSet* rules;
+    int gameLevel;
+    int cellPlacer[MAX_CELLS + 1];
+    long long hurdleSpent[HURDLE_KINDS];
+    long long hurdleInflicted[HURDLE_KINDS];
+    long long helperSpent[HELPER_KINDS];
+    long long helperAvoided[HELPER_KINDS];
+    int goalRound[MAX_SEATS];
+    int seatsThisGame;
+    int hurdlesThisGame;
+    int helpersThisGame;
+
+    long long gamesPlayed;
+    long long timeouts;
+    int seatsSeen;
+    RunningStat winRate[5][MAX_SEATS];
+    RunningStat drawRate[5];
+    RunningStat timeoutRate[5];
+    RunningStat turnsToGoal[5][MAX_SEATS];
+    long long hurdlePlacements[HURDLE_KINDS];
+    long long hurdleHits[HURDLE_KINDS];
+    long long hurdleNeutralized[HURDLE_KINDS];
+    long long hurdlePenalty[HURDLE_KINDS];
+    long long hurdleBlockTurns[HURDLE_KINDS];
+    RunningStat hurdleReturn[HURDLE_KINDS];
+    long long helperPurchases[HELPER_KINDS];
+    long long helperNeutralizations[HELPER_KINDS];
+    long long helperManualUses[HELPER_KINDS];
+    RunningStat helperReturn[HELPER_KINDS];
+
+
+public:
+    BalanceAnalytics(ColumnarWriter* columns, int seatColumns);
+    void onGameStart(const AdventureQuest& game) override;
+    void onHurdlePlaced(int seat, ItemKind kind, int cell, int spent) override;
+    void onHurdleHit(int seat, const Hurdle& hurdle, int cell, int pointsLost, int blockedTurns, bool neutralized) override;
+    void onHelperBought(int seat, ItemKind kind, int spent) override;
+    void onHelperUsed(int seat, ItemKind kind, ItemKind hurdleKind) override;
+    void onGoalReached(int seat, int round) override;
+    void onGameEnd(const AdventureQuest& game, int winner, bool finished) override;
+    long long getGamesPlayed() const { return gamesPlayed; }
+    static const char* const* columnNames();
+    static int columnCount(int seats) { return GAME_COLUMNS + SEAT_COLUMNS * seats; }
+    bool writeSummary(const string& path) const;
+};
+struct SweepTally
+{
+    static constexpr int MAX_SEATS = AdventureQuest::MAX_PLAYERS;
+
+    long long games;
+    long long seats;
+    long long wins[MAX_SEATS];
+    long long draws;
+    long long timeouts;
+    long long finished;
+    long long rounds;
+    long long points[MAX_SEATS];
+    long long hurdles;
+    long long helpers;
+
+    void merge(const SweepTally& other);
+};
+class SweepObserver : public GameObserver
+{
+private:
+    SweepTally* tally;
+
+public:
+    SweepObserver(SweepTally* tally) : tally(tally) {}
+    void onHurdlePlaced(int /*seat*/, ItemKind /*kind*/, int /*cell*/, int /*spent*/) override { tally->hurdles++; }
+    void onHelperBought(int /*seat*/, ItemKind /*kind*/, int /*spent*/) override { tally->helpers++; }
+    void onGameEnd(const AdventureQuest& game, int winner, bool finished) override;
+};
+class RuleSweep
+{
+private:
+    static const int MAX_KEYS = 32;
+    static const int MAX_VALUES = 256;
+
+    int keyCount;
+    string keys[MAX_KEYS];
+    int valueCount[MAX_KEYS];
+    int values[MAX_KEYS][MAX_VALUES];
+    int configCount;
+    int* choices;
+
+public:
+    RuleSweep() : keyCount(0), configCount(0), choices(nullptr) {}
+    RuleSweep(const RuleSweep&) = delete;
+    RuleSweep& operator=(const RuleSweep&) = delete;
+    ~RuleSweep() { delete[] choices; }
+    bool load(const string& path, string& error);
+    long long gridSize() const;
+    void enumerate();
+    void sample(int count, uint64_t seed);
+    int getConfigCount() const { return configCount; }
+    void apply(int config, RuleSet& rules) const;
+    bool writeResults(const string& path, const SweepTally* tallies) const;
+};
+class SweepCheckpoint
+{
+private:
+    static const int HEADER_WORDS = 4;
+    static const int RECORD_WORDS = 1 + sizeof(SweepTally) / sizeof(int64_t) + 1;
+    static constexpr uint64_t MAGIC = 0x3250454557535141ULL;
+
+    ofstream file;
+
+public:
+    static uint64_t checksum(const int64_t* words, int count);
+    bool open(const string& path, uint64_t configHash, long long units, SweepTally* tallies, atomic<uint8_t>* done, long long& restored, string& error);
+    void append(long long unit, const SweepTally& tally);
+    bool flush();
+};
+static_assert(sizeof(SweepTally) % sizeof(int64_t) == 0, "checkpoint records store SweepTally as 64-bit words");
+struct PackedBoard
+{
+    uint64_t seed;
+    uint64_t hash;
+    uint64_t masks[7][2];
+};
+struct BoardPackHeader
+{
+    uint64_t magic;
+    uint64_t recordSize;
+    uint64_t first[4];
+    uint64_t count[4];
+};
+class BoardPack
+{
+private:
+    static constexpr uint64_t MAGIC = 0x314B434150514141ULL;
+
+    const char* mapping;
+    size_t mappedSize;
+    bool mapped;
+    const BoardPackHeader* header;
+    const PackedBoard* records;
+
+public:
+    BoardPack() : mapping(nullptr), mappedSize(0), mapped(false), header(nullptr), records(nullptr) {}
+    BoardPack(const BoardPack&) = delete;
+    BoardPack& operator=(const BoardPack&) = delete;
+    ~BoardPack() { close(); }
+    static PackedBoard pack(const Board& board);
+    static bool generate(const string& path, long long perLevel, uint64_t seed, int itemDensity, long long* uniqueCounts, string& error);
+    bool open(const string& path, string& error);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+    long long getCount(int level) const { return static_cast<long long>(header->count[level - 1]); }
+    const PackedBoard& record(int level, long long index) const { return records[header->first[level - 1] + index]; }
+    void load(int level, long long index, Board& board) const;
+};
+static_assert(sizeof(PackedBoard) == 128, "pack records are fixed 128-byte slots");
+struct ReplayHeader
+{
+    uint64_t id;
+    uint64_t seed;
+    int32_t level;
+    int32_t players;
+    int32_t turns;
+    int32_t interval;
+    int32_t keyframes;
+    int32_t reserved;
+};
+struct ReplayIndexEntry
+{
+    uint64_t id;
+    uint64_t offset;
+};
+class ReplayWriter
+{
+private:
+    static constexpr uint64_t DATA_MAGIC = 0x3159414C50455241ULL;
+    static constexpr uint64_t INDEX_MAGIC = 0x3158444E49455241ULL;
+
+    ofstream data;
+    string indexPath;
+    ReplayIndexEntry* index;
+    long long gameCount;
+    long long capacity;
+    uint64_t offset;
+    int interval;
+    string decisions;
+    string keyframes;
+    uint64_t* keyframeOffsets;
+    int keyframeCapacity;
+    string record;
+
+public:
+    ReplayWriter() : index(nullptr), gameCount(0), capacity(0), offset(0), interval(32), keyframeOffsets(nullptr), keyframeCapacity(0) {}
+    ReplayWriter(const ReplayWriter&) = delete;
+    ReplayWriter& operator=(const ReplayWriter&) = delete;
+    ~ReplayWriter();
+    bool open(const string& prefix, int interval, string& error);
+    int addGame(uint64_t id, AdventureQuest& game, Bot* const* bots, int maxRounds);
+    bool close(string& error);
+    long long getGameCount() const { return gameCount; }
+    uint64_t getBytes() const { return offset; }
+
+    friend class ReplayReader;
+};
+class ReplayReader
+{
+private:
+    ifstream data;
+    ReplayIndexEntry* index;
+    long long gameCount;
+    string buffer;
+
+public:
+    ReplayReader() : index(nullptr), gameCount(0) {}
+    ReplayReader(const ReplayReader&) = delete;
+    ReplayReader& operator=(const ReplayReader&) = delete;
+    ~ReplayReader() { delete[] index; }
+    bool open(const string& prefix, string& error);
+    long long getGameCount() const { return gameCount; }
+    uint64_t getGameId(long long i) const { return index[i].id; }
+    bool readHeader(uint64_t id, ReplayHeader& header, uint64_t& recordOffset);
+    bool seek(uint64_t id, int turn, AdventureQuest& game, string& error, bool fromStart = false);
+};
+struct SharedPlayer
+{
+    static constexpr int INVENTORY_SLOTS = 10;
+    int32_t cell;
+    int32_t points;
+    int32_t gold;
+    int32_t silver;
+    int32_t blockedTurns;
+    uint8_t reachedGoal;
+    uint8_t inventorySize;
+    uint8_t inventory[INVENTORY_SLOTS];
+    uint8_t uses[INVENTORY_SLOTS];
+};
+struct SharedSnapshot
+{
+    int32_t level;
+    int32_t boardSize;
+    int32_t round;
+    int32_t goalNumber;
+    int32_t playerCount;
+    int32_t finished;
+    uint8_t cellNumbers[11 * 11];
+    uint8_t kinds[11 * 11 + 1];
+    SharedPlayer players[AdventureQuest::MAX_PLAYERS];
+};
+struct SharedRegion
+{
+    static const uint32_t MAGIC = 0x41515348;
+    uint32_t magic;
+    uint32_t snapshotSize;
+    atomic<uint32_t> writerActive;
+    atomic<uint32_t> sequence;
+    SharedSnapshot snapshot;
+};
+static_assert(atomic<uint32_t>::is_always_lock_free, "the seqlock counter is shared between processes and must be lock-free");
+class StatePublisher
+{
+private:
+    string name;
+    SharedRegion* region;
+
+public:
+    StatePublisher() : region(nullptr) {}
+    StatePublisher(const StatePublisher&) = delete;
+    StatePublisher& operator=(const StatePublisher&) = delete;
+    ~StatePublisher() { close(); }
+    bool open(const string& name, string& error);
+    void close();
+    bool isOpen() const { return region != nullptr; }
+    void publish(const AdventureQuest& game);
+};
+class StateReader
+{
+private:
+    const SharedRegion* region;
+
+public:
+    StateReader() : region(nullptr) {}
+    StateReader(const StateReader&) = delete;
+    StateReader& operator=(const StateReader&) = delete;
+    ~StateReader() { close(); }
+    bool open(const string& name, string& error);
+    void close();
+    bool isWriterActive() const { return region->writerActive.load(memory_order_acquire) != 0; }
+    bool read(SharedSnapshot& out, uint32_t& sequence) const;
+};
+BitBoard BitBoard::below(int num)
+{
+    if (num <= 0)
+    {
+        return BitBoard();
+    }
+    if (num < 64)
+    {
+        return BitBoard((1ULL << num) - 1, 0);
+    }
+    if (num < 128)
+    {
+        return BitBoard(~0ULL, num == 64 ? 0 : (1ULL << (num - 64)) - 1);
+    }
+    return BitBoard(~0ULL, ~0ULL);
+}
+BitBoard BitBoard::range(int first, int last)
+{
+    if (first > last)
+    {
+        return BitBoard();
     }
+    return below(last + 1) & ~below(first);
+}
+template <int N>
+const Board::Layout& Board::layoutFor()
+{
+    static const Layout layout = { N, Serpentine<N>::numberToX.data(), Serpentine<N>::numberToY.data(), Serpentine<N>::cellNumbers.data(), &Board::printCells<N>, &Board::placeInitialItems<N> };
+    return layout;
+}
+Board::Board(int level) : Board(level, static_cast<uint64_t>(time(0)))
+{
+}
+Board::Board(int level, uint64_t seed, int itemDensity) : itemDensity(itemDensity)
+{
+    reset(level, seed);
+}
+void Board::reset(int level, uint64_t seed)
+{
+    this->seed = seed;
+    selectLayout(level);
+    items.fill(BitBoard());
     initializeItems();
 }
+void Board::load(int level, uint64_t seed, const BitBoard* masks)
+{
+    this->seed = seed;
+    selectLayout(level);
+    BitBoard onBoard = BitBoard::range(1, size * size);
+    for (int slot = 0; slot < BOARD_KINDS; ++slot)
+    {
+        items[slot] = masks[slot] & onBoard;
+    }
+}
+void Board::selectLayout(int level)
+{
+    this->level = level;
+    if (level == 1)
+    {
+        layout = &layoutFor<5>();
+    }
+    else if (level == 2)
+    {
+        layout = &layoutFor<7>();
+    }
+    else if (level == 3)
+    {
+        layout = &layoutFor<9>();
+    }
+    else
+    {
+        layout = &layoutFor<11>();
+    }
 
-Board::Board(const Board& other) : size(other.size), level(other.level)
+    size = layout->size;
+}
+Item* Board::prototype(ItemKind kind)
 {
-    cells = new Item * *[size];
-    player1Path = new bool* [size];
-    player2Path = new bool* [size];
-    cellNumbers = new int* [size];
-    for (int i = 0; i < size; ++i)
+    static GoldCoin gold;
+    static SilverCoin silver;
+    static Fire fire;
+    static Snake snake;
+    static Ghost ghost;
+    static Lion lion;
+    static Lock lock;
+    static Item* const prototypes[BOARD_KINDS] = { &gold, &silver, &fire, &snake, &ghost, &lion, &lock };
+    if (kind == KIND_COUNT || (kind > KIND_SILVER && kind < KIND_FIRE))
     {
-        cells[i] = new Item * [size];
-        player1Path[i] = new bool[size];
-        player2Path[i] = new bool[size];
-        cellNumbers[i] = new int[size];
-        for (int j = 0; j < size; ++j)
+        return nullptr;
+    }
+    return prototypes[slotOf(kind)];
+}
+Item* Board::getItem(int x, int y) const
+{
+    return prototype(getKind(positionToNumber(x, y)));
+}
+ItemKind Board::getKind(int num) const
+{
+    if (num < 1 || num > size * size)
+    {
+        return KIND_COUNT;
+    }
+    for (int slot = 0; slot < BOARD_KINDS; ++slot)
+    {
+        if (items[slot].test(num))
         {
-            cells[i][j] = other.cells[i][j] ? other.cells[i][j]->clone() : nullptr;
-            player1Path[i][j] = other.player1Path[i][j];
-            player2Path[i][j] = other.player2Path[i][j];
-            cellNumbers[i][j] = other.cellNumbers[i][j];
+            return kindOfSlot(slot);
         }
     }
-    int totalCells = size * size;
-    numberToPosX = new int[totalCells + 1];
-    numberToPosY = new int[totalCells + 1];
-    for (int i = 1; i <= totalCells; ++i)
+    return KIND_COUNT;
+}
+void Board::setKind(int num, ItemKind kind)
+{
+    clearCell(num);
+    items[slotOf(kind)].set(num);
+}
+void Board::clearCell(int num)
+{
+    BitBoard keep = ~BitBoard::cell(num);
+    for (int slot = 0; slot < BOARD_KINDS; ++slot)
     {
-        numberToPosX[i] = other.numberToPosX[i];
-        numberToPosY[i] = other.numberToPosY[i];
+        items[slot] &= keep;
     }
 }
-Board& Board::operator=(const Board& other)
+BitBoard Board::occupiedMask() const
 {
-    if (this != &other)
+    BitBoard mask;
+    for (int slot = 0; slot < BOARD_KINDS; ++slot)
     {
-        for (int i = 0; i < size; ++i)
-        {
-            for (int j = 0; j < size; ++j)
-            {
-                delete cells[i][j];
-            }
-            delete[] cells[i];
-            delete[] player1Path[i];
-            delete[] player2Path[i];
-            delete[] cellNumbers[i];
-        }
-        delete[] cells;
-        delete[] player1Path;
-        delete[] player2Path;
-        delete[] cellNumbers;
-        delete[] numberToPosX;
-        delete[] numberToPosY;
-
-        size = other.size;
-        level = other.level;
-        cells = new Item * *[size];
-        player1Path = new bool* [size];
-        player2Path = new bool* [size];
-        cellNumbers = new int* [size];
-        for (int i = 0; i < size; ++i)
-        {
-            cells[i] = new Item * [size];
-            player1Path[i] = new bool[size];
-            player2Path[i] = new bool[size];
-            cellNumbers[i] = new int[size];
-            for (int j = 0; j < size; ++j)
-            {
-                cells[i][j] = other.cells[i][j] ? other.cells[i][j]->clone() : nullptr;
-                player1Path[i][j] = other.player1Path[i][j];
-                player2Path[i][j] = other.player2Path[i][j];
-                cellNumbers[i][j] = other.cellNumbers[i][j];
-            }
-        }
-        int totalCells = size * size;
-        numberToPosX = new int[totalCells + 1];
-        numberToPosY = new int[totalCells + 1];
-        for (int i = 1; i <= totalCells; ++i)
-        {
-            numberToPosX[i] = other.numberToPosX[i];
-            numberToPosY[i] = other.numberToPosY[i];
-        }
+        mask |= items[slot];
     }
-    return *this;
+    return mask;
 }
-Board::~Board()
+BitBoard Board::hurdleMask() const
 {
-    for (int i = 0; i < size; ++i)
+    BitBoard mask;
+    for (int slot = slotOf(KIND_FIRE); slot < BOARD_KINDS; ++slot)
     {
-        for (int j = 0; j < size; ++j)
-        {
-            delete cells[i][j];
-        }
-        delete[] cells[i];
-        delete[] player1Path[i];
-        delete[] player2Path[i];
-        delete[] cellNumbers[i];
+        mask |= items[slot];
+    }
+    return mask;
+}
+bool Board::hurdleWithin(int fromNum, int k, int direction) const
+{
+    BitBoard ahead = direction < 0 ? BitBoard::range(max(fromNum - k, 1), fromNum - 1) : BitBoard::range(fromNum + 1, min(fromNum + k, size * size));
+    return (hurdleMask() & ahead).any();
+}
+int Board::countBetween(ItemKind kind, int first, int last) const
+{
+    return (items[slotOf(kind)] & BitBoard::range(max(min(first, last), 1), min(max(first, last), size * size))).count();
+}
+int Board::coinValueBetween(int first, int last) const
+{
+    return countBetween(KIND_GOLD, first, last) * 10 + countBetween(KIND_SILVER, first, last) * 5;
+}
+int Board::hurdleCostBetween(int first, int last, const RuleSet& rules) const
+{
+    int cost = 0;
+    for (int h = 0; h < HURDLE_KINDS; ++h)
+    {
+        cost += countBetween(static_cast<ItemKind>(KIND_FIRE + h), first, last) * rules.hurdles[h].penalty;
     }
-    delete[] cells;
-    delete[] player1Path;
-    delete[] player2Path;
-    delete[] cellNumbers;
-    delete[] numberToPosX;
-    delete[] numberToPosY;
+    return cost;
 }
 void Board::initializeItems()
 {
-    srand(static_cast<unsigned int>(time(0)));
-    int minItems = size == 5 ? 4 : size * 2 - 2;
-    int maxItems = size == 5 ? 10 : size * 4;
-    int numItems = minItems + (rand() % (maxItems - minItems + 1));
-
-    int goalX = size / 2;
-    int goalY = size / 2;
-    int player1StartX = size - 1;
-    int player1StartY = size - 1;
-    int player2StartX = 0;
-    int player2StartY = 0;
+    (this->*layout->initializeItems)();
+}
+template <int N>
+void Board::placeInitialItems()
+{
+    Rng rng(seed);
+    int minItems = N == 5 ? 4 : N * 2 - 2;
+    int maxItems = N == 5 ? 10 : N * 4;
+    int numItems = minItems + rng.nextInt(maxItems - minItems + 1);
+    numItems = min(numItems * itemDensity / 100, Serpentine<N>::CELLS - 3);
 
+    BitBoard taken = BitBoard::cell(Serpentine<N>::GOAL) | BitBoard::cell(1) | BitBoard::cell(Serpentine<N>::CELLS) | occupiedMask();
     for (int i = 0; i < numItems; ++i)
     {
-        int x, y;
+        int num;
         do
         {
-            x = rand() % size;
-            y = rand() % size;
-        } while (cells[x][y] != nullptr || (x == goalX && y == goalY) || (x == player2StartX && y == player2StartY) || (x == player1StartX && y == player1StartY));
-        if (rand() % 2)
-        {
-            cells[x][y] = new GoldCoin(x, y);
-        }
-        else
-        {
-            cells[x][y] = new SilverCoin(x, y);
-        }
+            int x = rng.nextInt(N);
+            int y = rng.nextInt(N);
+            num = Serpentine<N>::cellNumbers[x * N + y];
+        } while (taken.test(num));
+        taken.set(num);
+        items[slotOf(rng.nextInt(2) ? KIND_GOLD : KIND_SILVER)].set(num);
     }
 }
-void Board::markPlayerPath(int x, int y, bool isPlayer1)
+void Board::print(const Player* players, int playerCount) const
 {
-    if (x >= 0 && x < size && y >= 0 && y < size)
-    {
-        if (isPlayer1)
-        {
-            player1Path[x][y] = true;
-        }
-        else
-        {
-            player2Path[x][y] = true;
-        }
-    }
+    AQ_TRACE_SPAN("Board::print");
+    (this->*layout->print)(players, playerCount);
 }
-void Board::print(const Player* player1, const Player* player2) const
+template <int N>
+void Board::printCells(const Player* players, int playerCount) const
 {
-    int goalX = size / 2;
-    int goalY = size / 2;
+    static const char* const PATH_COLORS[] = { RED, BLUE, YELLOW, MAGENTA, CYAN };
+    int occupant[Serpentine<N>::CELLS + 1];
+    for (int num = 0; num <= Serpentine<N>::CELLS; ++num)
+    {
+        occupant[num] = -1;
+    }
+    for (int p = playerCount - 1; p >= 0; --p)
+    {
+        occupant[players[p].getCurrentNumber()] = p;
+    }
 
-    for (int j = 0; j < size; ++j)
+    const int goalX = N / 2;
+    const int goalY = N / 2;
+
+    for (int j = 0; j < N; ++j)
     {
-        cout << "+-----";
+        GameLog::out() << "+-----";
     }
-    cout << "+" << endl;
+    GameLog::out() << "+" << endl;
 
-    for (int i = 0; i < size; ++i)
+    for (int i = 0; i < N; ++i)
     {
-        for (int j = 0; j < size; ++j)
+        for (int j = 0; j < N; ++j)
         {
-            cout << "|";
-            string color = RESET;
+            int num = Serpentine<N>::cellNumbers[i * N + j];
+            GameLog::out() << "|";
+            const char* color = RESET;
             if (i == goalX && j == goalY)
             {
                 color = GREEN;
             }
-            else if (player1Path[i][j])
-            {
-                color = RED;
-            }
-            else if (player2Path[i][j])
+            else
             {
-                color = BLUE;
+                for (int p = 0; p < playerCount; ++p)
+                {
+                    if (players[p].getPath().test(num))
+                    {
+                        color = PATH_COLORS[p % 5];
+                        break;
+                    }
+                }
             }
-            cout << color << " ";
+            GameLog::out() << color << " ";
 
-            if (player1->getX() == i && player1->getY() == j)
-            {
-                cout << BOLD << "P1" << RESET;
-            }
-            else if (player2->getX() == i && player2->getY() == j)
+            Item* item = prototype(getKind(num));
+            if (occupant[num] >= 0)
             {
-                cout << BOLD << "P2" << RESET;
+                GameLog::out() << BOLD << "P" << occupant[num] + 1 << RESET;
             }
             else if (i == goalX && j == goalY)
             {
-                cout << "GOAL";
+                GameLog::out() << "GOAL";
             }
-            else if (cells[i][j])
+            else if (item)
             {
-                cout << cells[i][j]->getShortName();
+                GameLog::out() << item->getShortName();
             }
             else
             {
-                cout << "   ";
+                GameLog::out() << "   ";
             }
-            cout << " " << RESET;
+            GameLog::out() << " " << RESET;
         }
-        cout << "|" << endl;
+        GameLog::out() << "|" << endl;
 
-        for (int j = 0; j < size; ++j)
+        for (int j = 0; j < N; ++j)
         {
-            cout << "|" << setw(3) << cellNumbers[i][j] << "  ";
+            GameLog::out() << "|" << setw(3) << static_cast<int>(Serpentine<N>::cellNumbers[i * N + j]) << "  ";
         }
-        cout << "|" << endl;
+        GameLog::out() << "|" << endl;
 
-        for (int j = 0; j < size; ++j)
+        for (int j = 0; j < N; ++j)
         {
-            cout << "+-----";
+            GameLog::out() << "+-----";
         }
-        cout << "+" << endl;
+        GameLog::out() << "+" << endl;
     }
 }
 pair<int, int> Board::numberToPosition(int num) const
@@ -574,7 +1718,7 @@ pair<int, int> Board::numberToPosition(int num) const
     {
         return { -1, -1 };
     }
-    return { numberToPosX[num], numberToPosY[num] };
+    return { layout->numberToX[num], layout->numberToY[num] };
 }
 
 int Board::positionToNumber(int x, int y) const
@@ -583,88 +1727,186 @@ int Board::positionToNumber(int x, int y) const
     {
         return -1;
     }
-    return cellNumbers[x][y];
+    return layout->cellNumbers[x * size + y];
 }
 
-Player::Player(int startNum, Board* b, int level) : board(b), currentLevel(level), gold(10), silver(20), points(0), invSize(0), invCapacity(10), blockedTurns(0), historyCount(0), historyStart(0), hasReachedGoal(false)
+MoveHistory::MoveHistory(const MoveHistory& other) : head(other.head), spare(nullptr), used(other.used), length(other.length), last(other.last)
 {
-    inventory = new Item * [invCapacity]();
-    for (int i = 0; i < invCapacity; ++i)
+    if (head)
     {
-        inventory[i] = nullptr;
+        head->refs++;
     }
-    setPosition(startNum);
 }
-Player::Player(const Player& other) : X(other.X), Y(other.Y), currentNumber(other.currentNumber), board(other.board), gold(other.gold), silver(other.silver), points(other.points), invSize(other.invSize), invCapacity(other.invCapacity), blockedTurns(other.blockedTurns), currentLevel(other.currentLevel), historyCount(other.historyCount), historyStart(other.historyStart), hasReachedGoal(other.hasReachedGoal)
+MoveHistory& MoveHistory::operator=(const MoveHistory& other)
 {
-    inventory = new Item * [invCapacity]();
-    for (int i = 0; i < invCapacity; ++i)
+    if (other.head)
     {
-        inventory[i] = nullptr;
+        other.head->refs++;
     }
-    for (int i = 0; i < invSize && i < invCapacity; ++i)
+    release(head);
+    head = other.head;
+    used = other.used;
+    length = other.length;
+    last = other.last;
+    return *this;
+}
+MoveHistory::MoveHistory(MoveHistory&& other) noexcept : head(other.head), spare(other.spare), used(other.used), length(other.length), last(other.last)
+{
+    other.head = nullptr;
+    other.spare = nullptr;
+    other.used = 0;
+    other.length = 0;
+    other.last = 0;
+}
+MoveHistory& MoveHistory::operator=(MoveHistory&& other) noexcept
+{
+    if (this != &other)
     {
-        if (other.inventory[i])
-        {
-            inventory[i] = other.inventory[i]->clone();
-        }
+        swap(head, other.head);
+        swap(spare, other.spare);
+        used = other.used;
+        length = other.length;
+        last = other.last;
+        other.clear();
     }
-    for (int i = 0; i < MAX_HISTORY; ++i)
+    return *this;
+}
+MoveHistory::~MoveHistory()
+{
+    release(head);
+    while (spare)
     {
-        moveHistory[i] = other.moveHistory[i];
+        Node* next = spare->parent;
+        delete spare;
+        spare = next;
     }
 }
-Player& Player::operator=(const Player& other)
+void MoveHistory::reserve(int moves)
 {
-    if (this != &other)
+    for (int nodes = (moves + CHUNK - 1) / CHUNK + 1; nodes > 0; --nodes)
     {
-        for (int i = 0; i < invSize; ++i)
-        {
-            delete inventory[i];
-        }
-        delete[] inventory;
-
-        X = other.X;
-        Y = other.Y;
-        currentNumber = other.currentNumber;
-        board = other.board;
-        gold = other.gold;
-        silver = other.silver;
-        points = other.points;
-        invSize = other.invSize;
-        invCapacity = other.invCapacity;
-        blockedTurns = other.blockedTurns;
-        currentLevel = other.currentLevel;
-        historyCount = other.historyCount;
-        historyStart = other.historyStart;
-        hasReachedGoal = other.hasReachedGoal;
-
-        inventory = new Item * [invCapacity]();
-        for (int i = 0; i < invCapacity; ++i)
+        Node* node = new Node;
+        node->parent = spare;
+        spare = node;
+    }
+}
+MoveHistory::Node* MoveHistory::allocate()
+{
+    if (!spare)
+    {
+        return new Node;
+    }
+    Node* node = spare;
+    spare = node->parent;
+    return node;
+}
+int MoveHistory::valueAt(const Node* node, int index)
+{
+    int value = node->base;
+    for (int i = 0; i < index; ++i)
+    {
+        value += node->deltas[i];
+    }
+    return value;
+}
+void MoveHistory::release(Node* node)
+{
+    while (node && --node->refs == 0)
+    {
+        Node* parent = node->parent;
+        node->parent = spare;
+        spare = node;
+        node = parent;
+    }
+}
+void MoveHistory::push(int num)
+{
+    int delta = num - last;
+    if (head && head->refs == 1)
+    {
+        head->count = used;
+    }
+    if (head && used == head->count && used < CHUNK && delta >= INT8_MIN && delta <= INT8_MAX)
+    {
+        head->deltas[used - 1] = static_cast<int8_t>(delta);
+        head->count++;
+        used++;
+    }
+    else
+    {
+        Node* node = allocate();
+        node->parent = head;
+        node->parentUsed = used;
+        node->refs = 1;
+        node->count = 1;
+        node->base = num;
+        head = node;
+        used = 1;
+    }
+    last = num;
+    length++;
+}
+void MoveHistory::pop(int moves)
+{
+    moves = min(moves, length);
+    length -= moves;
+    while (head && moves >= used)
+    {
+        moves -= used;
+        Node* old = head;
+        head = old->parent;
+        used = old->parentUsed;
+        if (head)
         {
-            inventory[i] = nullptr;
+            head->refs++;
         }
-        for (int i = 0; i < invSize && i < invCapacity; ++i)
+        release(old);
+    }
+    used -= moves;
+    last = head ? valueAt(head, used - 1) : 0;
+}
+int MoveHistory::peek(int depth) const
+{
+    const Node* node = head;
+    int visible = used;
+    while (depth >= visible)
+    {
+        depth -= visible;
+        visible = node->parentUsed;
+        node = node->parent;
+    }
+    return valueAt(node, visible - 1 - depth);
+}
+void MoveHistory::copyTo(int* out) const
+{
+    int end = length;
+    int visible = used;
+    for (const Node* node = head; node; node = node->parent)
+    {
+        end -= visible;
+        int value = node->base;
+        for (int i = 0; i < visible; ++i)
         {
-            if (other.inventory[i])
+            out[end + i] = value;
+            if (i + 1 < visible)
             {
-                inventory[i] = other.inventory[i]->clone();
+                value += node->deltas[i];
             }
         }
-        for (int i = 0; i < MAX_HISTORY; ++i)
-        {
-            moveHistory[i] = other.moveHistory[i];
-        }
+        visible = node->parentUsed;
     }
-    return *this;
 }
-Player::~Player()
+void MoveHistory::clear()
 {
-    for (int i = 0; i < invSize; ++i)
-    {
-        delete inventory[i];
-    }
-    delete[] inventory;
+    release(head);
+    head = nullptr;
+    used = 0;
+    length = 0;
+    last = 0;
+}
+Player::Player(int seat, int startNum, int direction, Board* b, int level, const RuleSet* rules) : gold(rules->startGold), silver(rules->startSilver), points(0), board(b), invSize(0), blockedTurns(0), currentLevel(level), hasReachedGoal(false), seat(seat), direction(direction), rules(rules)
+{
+    setPosition(startNum);
 }
 void Player::addGold(int g)
 {
@@ -676,11 +1918,11 @@ void Player::addSilver(int s)
     silver += s;
     points += s * 5;
 }
-void Player::addItem(Item* item)
+void Player::addItem(const Helper& helper)
 {
-    if (invSize < invCapacity)
+    if (invSize < INVENTORY_CAPACITY)
     {
-        inventory[invSize++] = item->clone();
+        inventory[invSize++] = helper;
     }
 }
 void Player::block(int turns)
@@ -700,31 +1942,24 @@ void Player::clearBlock()
 }
 void Player::printStatus() const
 {
-    cout << "Cell: " << currentNumber << " (Position: (" << X << "," << Y << ")), Points=" << points << ", Gold=" << gold << ", Silver=" << silver << endl;
-    cout << "Inventory: ";
+    GameLog::out() << "Cell: " << currentNumber << " (Position: (" << X << "," << Y << ")), Points=" << points << ", Gold=" << gold << ", Silver=" << silver << endl;
+    GameLog::out() << "Inventory: ";
     if (invSize == 0)
     {
-        cout << "Empty";
+        GameLog::out() << "Empty";
     }
     else
     {
         for (int i = 0; i < invSize; ++i)
         {
-            if (inventory[i])
+            GameLog::out() << inventory[i].getName() << " (" << inventory[i].getUses() << ")";
+            if (i < invSize - 1)
             {
-                cout << inventory[i]->getName();
-                if (Helper* helper = dynamic_cast<Helper*>(inventory[i]))
-                {
-                    cout << " (" << helper->getUses() << ")";
-                }
-                if (i < invSize - 1)
-                {
-                    cout << ", ";
-                }
+                GameLog::out() << ", ";
             }
         }
     }
-    cout << endl;
+    GameLog::out() << endl;
 }
 void Player::deductPoints(int amount)
 {
@@ -761,16 +1996,16 @@ void Player::deductSilver(int amount)
         silver = 0;
     }
 }
-bool Player::checkInventory(const string& itemName) const
+int Player::findHelper(ItemKind kind) const
 {
     for (int i = 0; i < invSize; ++i)
     {
-        if (inventory[i] && inventory[i]->getName() == itemName)
+        if (inventory[i].getKind() == kind)
         {
-            return true;
+            return i;
         }
     }
-    return false;
+    return -1;
 }
 void Player::removeFromInventory(int index)
 {
@@ -778,214 +2013,148 @@ void Player::removeFromInventory(int index)
     {
         return;
     }
-    delete inventory[index];
     for (int i = index; i < invSize - 1; ++i)
     {
         inventory[i] = inventory[i + 1];
     }
-    inventory[invSize - 1] = nullptr;
     invSize--;
 }
-bool Player::hasWater() const
-{
-    return checkInventory("Water");
-}
-bool Player::hasSword() const
-{
-    return checkInventory("Sword");
-}
-bool Player::hasShield() const
-{
-    return checkInventory("Shield");
-}
-bool Player::hasKey() const
-{
-    return checkInventory("Key");
-}
-void Player::useWater()
-{
-    for (int i = 0; i < invSize; ++i)
-    {
-        if (inventory[i] && inventory[i]->getName() == "Water")
-        {
-            removeFromInventory(i);
-            break;
-        }
-    }
-}
-void Player::useSword()
-{
-    for (int i = 0; i < invSize; ++i)
-    {
-        if (inventory[i] && inventory[i]->getName() == "Sword")
-        {
-            Helper* helper = dynamic_cast<Helper*>(inventory[i]);
-            helper->decrementUse();
-            if (helper->getUses() <= 0)
-            {
-                removeFromInventory(i);
-            }
-            break;
-        }
-    }
-}
-void Player::useShield()
+bool Player::useHelper(ItemKind kind)
 {
-    for (int i = 0; i < invSize; ++i)
+    int index = findHelper(kind);
+    if (index < 0)
     {
-        if (inventory[i] && inventory[i]->getName() == "Shield")
-        {
-            removeFromInventory(i);
-            break;
-        }
+        return false;
     }
-}
-void Player::useKey()
-{
-    for (int i = 0; i < invSize; ++i)
+    inventory[index].decrementUse();
+    if (inventory[index].getUses() <= 0)
     {
-        if (inventory[i] && inventory[i]->getName() == "Key")
-        {
-            removeFromInventory(i);
-            break;
-        }
+        removeFromInventory(index);
     }
+    return true;
 }
 void Player::recordMove(int num)
 {
-    int index = (historyStart + historyCount) % MAX_HISTORY;
-    moveHistory[index] = num;
-
-    if (historyCount < MAX_HISTORY)
-    {
-        historyCount++;
-    }
-    else
-    {
-        historyStart = (historyStart + 1) % MAX_HISTORY;
-    }
-    auto pos = board->numberToPosition(num);
-    board->markPlayerPath(pos.first, pos.second, this->X == 0 && this->Y == 0);
+    history.push(num);
+    path.set(num);
 }
 void Player::moveBack(int cells)
 {
-    if (historyCount <= 1)
+    if (history.size() <= 1)
     {
         return;
     }
 
-    int movesToGoBack = min(cells, historyCount - 1);
-    int newIndex = (historyStart + historyCount - 1 - movesToGoBack) % MAX_HISTORY;
-    int newNum = moveHistory[newIndex];
+    int movesToGoBack = min(cells, history.size() - 1);
+    int newNum = history.peek(movesToGoBack);
 
     setPosition(newNum);
-    historyCount -= movesToGoBack;
+    history.pop(movesToGoBack);
 
-    cout << "Moved back " << movesToGoBack << " cells to cell " << currentNumber << " (" << X << "," << Y << ")" << endl;
+    GameLog::out() << "Moved back " << movesToGoBack << " cells to cell " << currentNumber << " (" << X << "," << Y << ")" << endl;
 }
 void Player::levelUp(int startNum)
 {
     currentLevel++;
     gold += 5;
     silver += 10;
-    historyCount = 0;
-    historyStart = 0;
+    history.clear();
+    hasReachedGoal = false;
+    blockedTurns = 0;
+    path = BitBoard();
+    setPosition(startNum);
+}
+void Player::enterBoard(Board* b, int startNum, int direction)
+{
+    board = b;
+    currentLevel = b->getLevel();
+    this->direction = direction;
+    history.clear();
+    hasReachedGoal = false;
+    blockedTurns = 0;
+    path = BitBoard();
+    setPosition(startNum);
+}
+void Player::restart(int startNum, int level)
+{
+    currentLevel = level;
+    gold = rules->startGold;
+    silver = rules->startSilver;
+    points = 0;
+    invSize = 0;
+    history.clear();
     hasReachedGoal = false;
     blockedTurns = 0;
+    path = BitBoard();
     setPosition(startNum);
 }
-void Player::placeHurdle(Item* hurdle)
+int Player::placeHurdle(const Item* hurdle, int placeNum)
 {
     if (!board || !hurdle)
     {
-        delete hurdle;
-        return;
+        return -1;
     }
 
-    int placeNum;
-    cout << "Enter cell number to place hurdle (1-" << board->getSize() * board->getSize() << "): ";
-    cin >> placeNum;
+    if (placeNum == PROMPT_CELL)
+    {
+        cout << "Enter cell number to place hurdle (1-" << board->getSize() * board->getSize() << "): ";
+        readInput(placeNum);
+    }
 
     auto pos = board->numberToPosition(placeNum);
     if (pos.first == -1)
     {
-        cout << "Invalid cell number!" << endl;
-        delete hurdle;
-        return;
+        GameLog::out() << "Invalid cell number!" << endl;
+        return -1;
     }
 
-    if (board->cells[pos.first][pos.second])
+    if (!board->isEmpty(placeNum))
     {
-        cout << "Cell already occupied!" << endl;
-        delete hurdle;
-        return;
+        GameLog::out() << "Cell already occupied!" << endl;
+        return -1;
     }
 
-    board->cells[pos.first][pos.second] = hurdle;
-    cout << "Placed " << hurdle->getName() << " at cell " << placeNum << " (" << pos.first << "," << pos.second << ")" << endl;
+    board->setKind(placeNum, hurdle->getKind());
+    GameLog::out() << "Placed " << hurdle->getName() << " at cell " << placeNum << " (" << pos.first << "," << pos.second << ")" << endl;
+    return placeNum;
 }
-string Player::getCurrentHurdle() const
+ItemKind Player::getCurrentHurdle() const
 {
-    if (board && X >= 0 && X < board->getSize() && Y >= 0 && Y < board->getSize())
-    {
-        Item* item = board->cells[X][Y];
-        if (Hurdle* hurdle = dynamic_cast<Hurdle*>(item))
-        {
-            return hurdle->getName();
-        }
-    }
-    return "None";
+    ItemKind kind = board ? board->getKind(currentNumber) : KIND_COUNT;
+    return isHurdleKind(kind) ? kind : KIND_COUNT;
 }
 void Player::clearHurdle()
 {
-    if (board && X >= 0 && X < board->getSize() && Y >= 0 && Y < board->getSize())
+    if (getCurrentHurdle() != KIND_COUNT)
     {
-        Item* cell = board->cells[X][Y];
-        if (dynamic_cast<Hurdle*>(cell))
-        {
-            delete cell;
-            board->cells[X][Y] = nullptr;
-        }
+        board->clearCell(currentNumber);
     }
 }
 void Player::displayInventory() const
 {
     if (invSize == 0)
     {
-        cout << "Inventory is empty!" << endl;
+        GameLog::out() << "Inventory is empty!" << endl;
         return;
     }
-    cout << "Inventory:" << endl;
+    GameLog::out() << "Inventory:" << endl;
     for (int i = 0; i < invSize; i++)
     {
-        if (inventory[i])
-        {
-            cout << i + 1 << ". " << inventory[i]->getName();
-            if (Helper* helper = dynamic_cast<Helper*>(inventory[i]))
-            {
-                cout << " (Uses: " << helper->getUses() << ")";
-            }
-            cout << endl;
-        }
+        GameLog::out() << i + 1 << ". " << inventory[i].getName() << " (Uses: " << inventory[i].getUses() << ")" << endl;
     }
 }
 bool Player::useItem(int index)
 {
-    if (index < 0 || index >= invSize || !inventory[index])
-    {
-        return false;
-    }
-
-    Helper* helper = dynamic_cast<Helper*>(inventory[index]);
-    if (!helper)
+    if (index < 0 || index >= invSize)
     {
         return false;
     }
+    Helper* helper = &inventory[index];
 
-    string currentHurdle = getCurrentHurdle();
+    ItemKind currentHurdle = getCurrentHurdle();
     if (!helper->canUseOn(currentHurdle))
     {
-        cout << helper->getName() << " cannot be used on " << currentHurdle << "!" << endl;
+        GameLog::out() << helper->getName() << " cannot be used on " << ITEM_NAMES[currentHurdle] << "!" << endl;
         return false;
     }
 
@@ -1006,639 +2175,5567 @@ void Player::setPosition(int num)
     currentNumber = num;
     recordMove(num);
 }
-GoldCoin::GoldCoin(int x, int y) : Item(x, y)
+GoldCoin::GoldCoin() : Item(KIND_GOLD)
 {
-    name = "Gold";
 }
 void GoldCoin::interact(Player& player)
 {
     player.addGold(1);
-    cout << "Picked up Gold Coin! (+10 points)" << endl;
+    GameLog::out() << "Picked up Gold Coin! (+10 points)" << endl;
 }
 Item* GoldCoin::clone() const
 {
     return new GoldCoin(*this);
 }
-SilverCoin::SilverCoin(int x, int y) : Item(x, y)
+SilverCoin::SilverCoin() : Item(KIND_SILVER)
 {
-    name = "Silver";
 }
 
 void SilverCoin::interact(Player& player)
 {
     player.addSilver(1);
-    cout << "Picked up Silver Coin! (+5 points)" << endl;
+    GameLog::out() << "Picked up Silver Coin! (+5 points)" << endl;
 }
 Item* SilverCoin::clone() const
 {
     return new SilverCoin(*this);
 }
-Helper::Helper(int x, int y, int c, int u) : Item(x, y), cost(c), uses(u) {}
-int Helper::getCost() const
-{
-    return cost;
-}
-int Helper::getUses() const
-{
-    return uses;
-}
-Helper::~Helper() {}
-void Helper::decrementUse()
+string costNames(int points, int gold, int silver)
 {
-    if (uses > 0)
+    string names;
+    const char* const labels[3] = { "points", "gold", "silver" };
+    const int amounts[3] = { points, gold, silver };
+    for (int i = 0; i < 3; ++i)
     {
-        uses--;
+        if (amounts[i] > 0)
+        {
+            names += (names.empty() ? "" : " or ") + string(labels[i]);
+        }
     }
+    return names;
 }
-Sword::Sword(int x, int y) : Helper(x, y, 40, 2)
+string costAmounts(int points, int gold, int silver)
 {
-    name = "Sword";
+    string amounts;
+    const char* const labels[3] = { " points", " gold", " silver" };
+    const int values[3] = { points, gold, silver };
+    for (int i = 0; i < 3; ++i)
+    {
+        if (values[i] > 0)
+        {
+            amounts += (amounts.empty() ? "-" : ", -") + to_string(values[i]) + labels[i];
+        }
+    }
+    return amounts.empty() ? "free" : amounts;
 }
-
-void Sword::interact(Player& player)
+Helper::Helper(ItemKind k) : Item(k), uses(DEFAULT_RULES.helper(k).uses) {}
+void Helper::interact(Player& player)
 {
-    if (player.getPoints() >= getCost())
+    const HelperRule& rule = player.getRules().helper(kind);
+    if (player.getPoints() >= rule.cost && player.getSilver() >= rule.silverCost)
     {
-        player.deductPoints(getCost());
-        player.addItem(this);
-        cout << "Bought Sword! (-40 points)" << endl;
+        player.deductPoints(rule.cost);
+        player.deductSilver(rule.silverCost);
+        uses = rule.uses;
+        player.addItem(*this);
+        GameLog::out() << "Bought " << getName() << "! (" << costAmounts(rule.cost, 0, rule.silverCost) << ")" << endl;
     }
     else
     {
-        cout << "Not enough points to buy Sword!" << endl;
+        GameLog::out() << "Not enough " << costNames(rule.cost, 0, rule.silverCost) << " to buy " << getName() << "!" << endl;
     }
 }
-void Sword::use(Player& player)
+int Helper::getUses() const
 {
-    player.clearHurdle();
-    cout << "Used Sword to clear hurdle!" << endl;
+    return uses;
 }
-bool Sword::canUseOn(const string& hurdleType) const
+Item* Helper::clone() const
 {
-    return hurdleType == "Snake" || hurdleType == "Lion";
+    return new Helper(*this);
 }
-Item* Sword::clone() const
+Helper::~Helper() {}
+void Helper::decrementUse()
 {
-    Sword* copy = new Sword(*this);
-    copy->uses = this->uses;
-    return copy;
+    if (uses > 0)
+    {
+        uses--;
+    }
 }
-Shield::Shield(int x, int y) : Helper(x, y, 30, 1)
+void Helper::use(Player& player) const
 {
-    name = "Shield";
+    const HelperRule& rule = player.getRules().helper(kind);
+    player.clearHurdle();
+    if (rule.clearsBlock)
+    {
+        player.clearBlock();
+    }
+    GameLog::out() << rule.useMessage << endl;
 }
-void Shield::interact(Player& player)
+Hurdle::Hurdle(ItemKind k) : Item(k) {}
+void Hurdle::applyEffect(Player& player) const
 {
-    if (player.getPoints() >= getCost())
+    const HurdleRule& rule = player.getRules().hurdle(kind);
+    if (player.useHelper(rule.neutralizer))
+    {
+        return;
+    }
+    player.block(rule.blockTurns);
+    if (rule.pushBack > 0)
+    {
+        player.moveBack(rule.pushBack);
+    }
+    player.deductPoints(rule.penalty);
+    GameLog::out() << "Blocked by " << getName() << "!";
+    if (rule.penalty > 0)
+    {
+        GameLog::out() << " -" << rule.penalty << " points,";
+    }
+    if (rule.pushBack > 0)
+    {
+        GameLog::out() << " moved back " << rule.pushBack << " cells,";
+    }
+    if (rule.neutralizer == KIND_KEY)
     {
-        player.deductPoints(getCost());
-        player.addItem(this);
-        cout << "Bought Shield! (-30 points)" << endl;
+        GameLog::out() << " Need a key to proceed." << endl;
     }
     else
     {
-        cout << "Not enough points to buy Shield!" << endl;
+        GameLog::out() << " wait " << rule.blockTurns << (rule.blockTurns == 1 ? " turn." : " turns.") << endl;
     }
 }
-void Shield::use(Player& player)
+void Hurdle::interact(Player& player)
 {
-    player.clearHurdle();
-    cout << "Used Shield to clear hurdle!" << endl;
+    place(player, PROMPT_CELL);
+}
+int Hurdle::place(Player& player, int cell) const
+{
+    const HurdleRule& rule = player.getRules().hurdle(kind);
+    if (player.getPoints() >= rule.cost && player.getGold() >= rule.goldCost && player.getSilver() >= rule.silverCost)
+    {
+        player.deductPoints(rule.cost);
+        player.deductGold(rule.goldCost);
+        player.deductSilver(rule.silverCost);
+        return player.placeHurdle(this, cell);
+    }
+    GameLog::out() << "Not enough " << costNames(rule.cost, rule.goldCost, rule.silverCost) << " to place " << getName() << "!" << endl;
+    return -1;
 }
-bool Shield::canUseOn(const string& hurdleType) const
+Hurdle::~Hurdle() {}
+Fire::Fire() : Hurdle(KIND_FIRE)
 {
-    return hurdleType == "Ghost";
 }
-Item* Shield::clone() const
+void Fire::interact(Player& player)
 {
-    Shield* copy = new Shield(*this);
-    copy->uses = this->uses;
-    return copy;
+    Hurdle::interact(player);
 }
-Water::Water(int x, int y) : Helper(x, y, 50, 1)
+Item* Fire::clone() const
 {
-    name = "Water";
+    return new Fire(*this);
 }
-void Water::interact(Player& player)
+Snake::Snake() : Hurdle(KIND_SNAKE)
 {
-    if (player.getPoints() >= getCost())
-    {
-        player.deductPoints(getCost());
-        player.addItem(this);
-        cout << "Bought Water! (-50 points)" << endl;
-    }
-    else {
-        cout << "Not enough points to buy Water!" << endl;
-    }
 }
-void Water::use(Player& player)
+
+void Snake::interact(Player& player)
 {
-    player.clearHurdle();
-    cout << "Used Water to clear hurdle!" << endl;
+    Hurdle::interact(player);
 }
-bool Water::canUseOn(const string& hurdleType) const
+
+Item* Snake::clone() const
 {
-    return hurdleType == "Fire";
+    return new Snake(*this);
 }
-Item* Water::clone() const
+Ghost::Ghost() : Hurdle(KIND_GHOST)
 {
-    Water* copy = new Water(*this);
-    copy->uses = this->uses;
-    return copy;
 }
-Key::Key(int x, int y) : Helper(x, y, 60, 1)
+void Ghost::interact(Player& player)
 {
-    name = "Key";
+    Hurdle::interact(player);
 }
-void Key::interact(Player& player)
+Item* Ghost::clone() const
 {
-    if (player.getSilver() >= 12)
-    {
-        player.deductSilver(12);
-        player.addItem(this);
-        cout << "Bought Key! (-12 silver)" << endl;
-    }
-    else
-    {
-        cout << "Not enough silver to buy Key!" << endl;
-    }
+    return new Ghost(*this);
 }
-void Key::use(Player& player)
+Lion::Lion() : Hurdle(KIND_LION)
 {
-    player.clearHurdle();
-    player.clearBlock();
-    cout << "Used Key to unlock!" << endl;
 }
-bool Key::canUseOn(const string& hurdleType) const
+void Lion::interact(Player& player)
 {
-    return hurdleType == "Lock";
+    Hurdle::interact(player);
 }
-Item* Key::clone() const
+Item* Lion::clone() const
 {
-    Key* copy = new Key(*this);
-    copy->uses = this->uses;
-    return copy;
+    return new Lion(*this);
 }
-Hurdle::Hurdle(int x, int y, int c, int p, int turns) : Item(x, y), cost(c), penalty(p), blockTurns(turns) {}
-void Hurdle::interact(Player& player)
+Lock::Lock() : Hurdle(KIND_LOCK)
 {
-    if (player.getPoints() >= getCost())
-    {
-        player.deductPoints(getCost());
-        player.placeHurdle(this->clone());
-    }
-    else
-    {
-        cout << "Not enough points to place " << name << "!" << endl;
-    }
 }
-int Hurdle::getCost() const
+void Lock::interact(Player& player)
 {
-    return cost;
+    Hurdle::interact(player);
 }
-int Hurdle::getPenalty() const
+Item* Lock::clone() const
 {
-    return penalty;
+    return new Lock(*this);
 }
-Hurdle::~Hurdle() {}
-Fire::Fire(int x, int y) : Hurdle(x, y, 50, 50, 2)
+void TurnScheduler::reset(const Player* players)
 {
-    name = "Fire";
+    finished = 0;
+    clearSleeping();
+    for (int seat = 0; seat < playerCount; ++seat)
+    {
+        if (players[seat].hasReachedGoalState())
+        {
+            markFinished(seat);
+        }
+    }
 }
-void Fire::interact(Player& player)
+void TurnScheduler::sleep(int seat, int round)
 {
-    Hurdle::interact(player);
+    sleeping |= 1ULL << seat;
+    wakeRound[seat] = round;
+    nextWake = min(nextWake, round);
 }
-void Fire::applyEffect(Player& player)
+uint64_t TurnScheduler::wake(int round)
 {
-    if (!player.hasWater())
+    if (round < nextWake)
     {
-        player.block(getBlockTurns());
-        player.deductPoints(getPenalty());
-        cout << "Blocked by Fire! -50 points, wait 2 turns." << endl;
+        return 0;
     }
-    else
+    uint64_t woken = 0;
+    nextWake = INT32_MAX;
+    uint64_t seats = sleeping;
+    while (seats)
     {
-        player.useWater();
+        int seat = takeNext(seats);
+        if (wakeRound[seat] <= round)
+        {
+            woken |= 1ULL << seat;
+        }
+        else
+        {
+            nextWake = min(nextWake, wakeRound[seat]);
+        }
     }
+    sleeping &= ~woken;
+    return woken;
 }
-Item* Fire::clone() const
+bool ActionQueue::push(const TurnAction& action)
 {
-    return new Fire(*this);
+    if (count == CAPACITY)
+    {
+        return false;
+    }
+    actions[(head + count) % CAPACITY] = action;
+    count++;
+    return true;
 }
-Snake::Snake(int x, int y) : Hurdle(x, y, 30, 30, 3)
+bool ActionQueue::pop(TurnAction& action)
 {
-    name = "Snake";
+    if (count == 0)
+    {
+        return false;
+    }
+    action = actions[head];
+    head = (head + 1) % CAPACITY;
+    count--;
+    return true;
 }
-
-void Snake::interact(Player& player)
+static bool matchesName(const string& word, string_view name)
 {
-    Hurdle::interact(player);
+    if (word.size() != name.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < word.size(); ++i)
+    {
+        if (word[i] != tolower(static_cast<unsigned char>(name[i])))
+        {
+            return false;
+        }
+    }
+    return true;
 }
-
-void Snake::applyEffect(Player& player)
+bool ActionQueue::parse(const string& script, string& error)
 {
-    if (!player.hasSword())
+    ActionQueue parsed;
+    size_t pos = 0;
+    while (pos < script.size())
     {
-        player.block(getBlockTurns());
-        player.moveBack(3);
-        player.deductPoints(getPenalty());
-        cout << "Blocked by Snake! -30 points, moved back 3 cells, wait 3 turns." << endl;
+        pos = script.find_first_not_of(" ,\t\r", pos);
+        if (pos == string::npos)
+        {
+            break;
+        }
+        size_t end = min(script.find_first_of(" ,\t\r", pos), script.size());
+        string token = script.substr(pos, end - pos);
+        pos = end;
+
+        size_t i = 0;
+        string word;
+        while (i < token.size() && isalpha(static_cast<unsigned char>(token[i])))
+        {
+            word += static_cast<char>(tolower(static_cast<unsigned char>(token[i])));
+            i++;
+        }
+        auto readNumber = [&](int& value)
+        {
+            size_t start = i;
+            value = 0;
+            while (i < token.size() && isdigit(static_cast<unsigned char>(token[i])) && i - start < 6)
+            {
+                value = value * 10 + (token[i] - '0');
+                i++;
+            }
+            return i > start;
+        };
+        int number = 0;
+        bool hasNumber = readNumber(number);
+        int cell = 0;
+        bool hasCell = false;
+        if (i < token.size() && token[i] == '@')
+        {
+            i++;
+            hasCell = readNumber(cell) && cell > 0;
+            if (!hasCell)
+            {
+                error = "missing cell in '" + token + "'";
+                return false;
+            }
+        }
+        if (i != token.size())
+        {
+            error = "cannot read '" + token + "'";
+            return false;
+        }
+
+        TurnAction action = { ACTION_NONE, 0, 0 };
+        int repeat = 1;
+        if (word == "m" || word == "move")
+        {
+            action.type = ACTION_MOVE;
+            repeat = hasNumber ? number : 1;
+        }
+        else if (word == "h" || word == "hurdle")
+        {
+            action = { ACTION_PLACE_HURDLE, number, cell };
+        }
+        else if (word == "b" || word == "buy")
+        {
+            action = { ACTION_BUY_HELPER, number, 0 };
+        }
+        else if (word == "u" || word == "use")
+        {
+            action = { ACTION_USE_ITEM, number, 0 };
+        }
+        else
+        {
+            for (int k = 0; k < HURDLE_KINDS; ++k)
+            {
+                if (matchesName(word, ITEM_NAMES[KIND_FIRE + k]))
+                {
+                    action = { ACTION_PLACE_HURDLE, hasNumber ? 0 : k + 1, cell };
+                }
+            }
+            for (int k = 0; k < HELPER_KINDS; ++k)
+            {
+                if (matchesName(word, ITEM_NAMES[KIND_SWORD + k]))
+                {
+                    action = { ACTION_BUY_HELPER, hasNumber ? 0 : k + 1, 0 };
+                }
+            }
+        }
+
+        if (action.type == ACTION_NONE || (action.type != ACTION_PLACE_HURDLE && hasCell))
+        {
+            error = "unknown action '" + token + "'";
+            return false;
+        }
+        if ((action.type == ACTION_PLACE_HURDLE && (action.choice < 1 || action.choice > HURDLE_KINDS)) || (action.type == ACTION_BUY_HELPER && (action.choice < 1 || action.choice > HELPER_KINDS)) || (action.type == ACTION_USE_ITEM && action.choice < 1) || repeat < 1)
+        {
+            error = "invalid choice in '" + token + "'";
+            return false;
+        }
+        if (action.type == ACTION_PLACE_HURDLE && !hasCell)
+        {
+            error = "hurdles need a target cell, e.g. fire@30";
+            return false;
+        }
+        for (int r = 0; r < repeat; ++r)
+        {
+            if (!parsed.push(action))
+            {
+                error = "at most " + to_string(CAPACITY) + " actions can be queued";
+                return false;
+            }
+        }
+    }
+    if (parsed.isEmpty())
+    {
+        error = "no actions given";
+        return false;
+    }
+    *this = parsed;
+    return true;
+}
+string ActionQueue::describe(const TurnAction& action)
+{
+    if (action.type == ACTION_MOVE)
+    {
+        return "Move";
+    }
+    if (action.type == ACTION_PLACE_HURDLE)
+    {
+        return "Place " + string(ITEM_NAMES[KIND_FIRE + action.choice - 1]) + " at cell " + to_string(action.cell);
+    }
+    if (action.type == ACTION_BUY_HELPER)
+    {
+        return "Buy " + string(ITEM_NAMES[KIND_SWORD + action.choice - 1]);
+    }
+    return "Use item " + to_string(action.choice);
+}
+AdventureQuest::AdventureQuest() : AdventureQuest(1, static_cast<uint64_t>(time(0)))
+{
+}
+AdventureQuest::AdventureQuest(int level, uint64_t seed, int playerCount, const RuleSet* rules) : currentLevel(level), seed(seed), roundNumber(0), roundSeat(MAX_PLAYERS), observer(nullptr), publisher(nullptr), scheduler(2), rules(rules)
+{
+    board = make_unique<Board>(currentLevel, levelSeed(currentLevel), rules->itemDensity);
+    int totalCells = board->getSize() * board->getSize();
+    this->playerCount = max(2, min(playerCount, maxPlayersFor(totalCells)));
+    players.reset(new Player[this->playerCount]);
+    for (int p = 0; p < this->playerCount; ++p)
+    {
+        players[p] = Player(p, startCell(p, this->playerCount, totalCells), startDirection(p), board.get(), currentLevel, rules);
+    }
+    goalNumber = (totalCells + 1) / 2;
+    scheduler = TurnScheduler(this->playerCount);
+    rebuildOccupancy();
+}
+AdventureQuest::AdventureQuest(const AdventureQuest& other) : currentLevel(other.currentLevel), goalNumber(other.goalNumber), seed(other.seed), roundNumber(other.roundNumber), roundSeat(other.roundSeat), observer(nullptr), publisher(nullptr), scheduler(other.scheduler), rules(other.rules)
+{
+    board = make_unique<Board>(*other.board);
+    copyPlayers(other);
+    settleBlocked();
+    rebuildOccupancy();
+}
+AdventureQuest::AdventureQuest(AdventureQuest&& other) noexcept : board(move(other.board)), players(move(other.players)), playerCount(other.playerCount), currentLevel(other.currentLevel), savedState(move(other.savedState)), goalNumber(other.goalNumber), seed(other.seed), roundNumber(other.roundNumber), roundSeat(other.roundSeat), observer(other.observer), publisher(other.publisher), scheduler(other.scheduler), nextBoard(move(other.nextBoard)), rules(other.rules), queues(move(other.queues))
+{
+    memcpy(occupancy, other.occupancy, sizeof(occupancy));
+    other.playerCount = 0;
+    other.observer = nullptr;
+    other.publisher = nullptr;
+}
+AdventureQuest& AdventureQuest::operator=(const AdventureQuest& other)
+{
+    if (this != &other)
+    {
+        discardNextBoard();
+        savedState.reset();
+        queues.reset();
+        if (board)
+        {
+            *board = *other.board;
+        }
+        else
+        {
+            board = make_unique<Board>(*other.board);
+        }
+        if (players && playerCount == other.playerCount)
+        {
+            for (int p = 0; p < playerCount; ++p)
+            {
+                players[p] = other.players[p];
+                players[p].board = board.get();
+            }
+        }
+        else
+        {
+            copyPlayers(other);
+        }
+        currentLevel = other.currentLevel;
+        goalNumber = other.goalNumber;
+        seed = other.seed;
+        roundNumber = other.roundNumber;
+        roundSeat = other.roundSeat;
+        scheduler = other.scheduler;
+        rules = other.rules;
+        settleBlocked();
+        rebuildOccupancy();
+    }
+    return *this;
+}
+AdventureQuest& AdventureQuest::operator=(AdventureQuest&& other) noexcept
+{
+    if (this != &other)
+    {
+        discardNextBoard();
+        board = move(other.board);
+        players = move(other.players);
+        playerCount = other.playerCount;
+        other.playerCount = 0;
+        savedState = move(other.savedState);
+        nextBoard = move(other.nextBoard);
+        queues = move(other.queues);
+        currentLevel = other.currentLevel;
+        goalNumber = other.goalNumber;
+        seed = other.seed;
+        roundNumber = other.roundNumber;
+        roundSeat = other.roundSeat;
+        scheduler = other.scheduler;
+        rules = other.rules;
+        observer = other.observer;
+        publisher = other.publisher;
+        other.observer = nullptr;
+        other.publisher = nullptr;
+        memcpy(occupancy, other.occupancy, sizeof(occupancy));
+    }
+    return *this;
+}
+void AdventureQuest::copyPlayers(const AdventureQuest& other)
+{
+    playerCount = other.playerCount;
+    players.reset(new Player[playerCount]);
+    for (int p = 0; p < playerCount; ++p)
+    {
+        players[p] = other.players[p];
+        players[p].board = board.get();
+    }
+}
+void AdventureQuest::prefetchNextLevel()
+{
+    if (nextBoard.valid() || currentLevel >= 4)
+    {
+        return;
+    }
+    int level = currentLevel + 1;
+    uint64_t boardSeed = levelSeed(level);
+    int itemDensity = rules->itemDensity;
+    nextBoard = async(launch::async, [level, boardSeed, itemDensity]() { return make_unique<Board>(level, boardSeed, itemDensity); });
+}
+unique_ptr<Board> AdventureQuest::takeNextBoard()
+{
+    if (!nextBoard.valid())
+    {
+        return nullptr;
+    }
+    unique_ptr<Board> next = nextBoard.get();
+    if (next->getLevel() != currentLevel || next->getSeed() != levelSeed(currentLevel))
+    {
+        return nullptr;
+    }
+    return next;
+}
+void AdventureQuest::discardNextBoard()
+{
+    if (nextBoard.valid())
+    {
+        nextBoard.get();
+    }
+}
+int AdventureQuest::startCell(int seat, int playerCount, int totalCells)
+{
+    int perSide = (playerCount + 1) / 2;
+    int spacing = max(1, ((totalCells + 1) / 2 - 1) / perSide);
+    if (seat % 2 == 0)
+    {
+        return totalCells - (seat / 2) * spacing;
+    }
+    return 1 + (seat / 2) * spacing;
+}
+void AdventureQuest::rebuildOccupancy()
+{
+    memset(occupancy, 0, sizeof(occupancy));
+    for (int p = 0; p < playerCount; ++p)
+    {
+        occupancy[players[p].getCurrentNumber()]++;
+    }
+}
+void AdventureQuest::saveGame()
+{
+    AQ_TRACE_SPAN("saveGame");
+    if (!savedState && spareState)
+    {
+        savedState = move(spareState);
+    }
+    if (savedState)
+    {
+        *savedState = *this;
+    }
+    else
+    {
+        savedState = make_unique<AdventureQuest>(*this);
+    }
+    GameLog::out() << "Game state saved!" << endl;
+}
+void AdventureQuest::discardSavedGame()
+{
+    if (savedState)
+    {
+        spareState = move(savedState);
+    }
+}
+void AdventureQuest::loadGame()
+{
+    AQ_TRACE_SPAN("loadGame");
+    if (savedState)
+    {
+        unique_ptr<AdventureQuest> saved = move(savedState);
+        *this = *saved;
+        spareState = move(saved);
+        GameLog::out() << "Game state loaded!" << endl;
+    }
+    else
+    {
+        GameLog::out() << "No saved game available!" << endl;
+    }
+}
+bool AdventureQuest::skipTurn(int seat)
+{
+    Player* player = &players[seat];
+    if (player->isBlocked())
+    {
+        GameLog::out() << "Player " << seat + 1 << " is blocked for " << player->blockedTurns << " more turns!" << endl;
+        player->unblock();
+        return true;
+    }
+
+    if (player->hasReachedGoalState())
+    {
+        GameLog::out() << "Player has reached the goal and is waiting." << endl;
+        return true;
+    }
+    return false;
+}
+int AdventureQuest::coinValueAhead(int seat) const
+{
+    const Player* player = &players[seat];
+    if (player->hasReachedGoalState())
+    {
+        return 0;
+    }
+    return board->coinValueBetween(player->getCurrentNumber() + player->getDirection(), goalNumber);
+}
+int AdventureQuest::hurdleCostAhead(int seat) const
+{
+    const Player* player = &players[seat];
+    if (player->hasReachedGoalState())
+    {
+        return 0;
+    }
+    return board->hurdleCostBetween(player->getCurrentNumber() + player->getDirection(), goalNumber, *rules);
+}
+int AdventureQuest::closestOpponent(int seat) const
+{
+    int target = -1;
+    int closest = INT32_MAX;
+    for (int q = 0; q < playerCount; ++q)
+    {
+        int remaining = abs(goalNumber - players[q].getCurrentNumber());
+        if (q != seat && !players[q].hasReachedGoalState() && remaining < closest)
+        {
+            target = q;
+            closest = remaining;
+        }
+    }
+    return target;
+}
+void AdventureQuest::playTurn(int seat)
+{
+    AQ_TRACE_SPAN("playTurn");
+    if (queues && !queues[seat].isEmpty())
+    {
+        playQueuedTurn(seat);
+        return;
+    }
+    Player* player = &players[seat];
+    GameLog::out() << endl;
+    GameLog::out() << "Player " << seat + 1 << "'s turn:" << endl;
+    player->printStatus();
+    GameLog::out() << "Ahead: " << coinValueAhead(seat) << " points in coins, " << hurdleCostAhead(seat) << " points in hurdle penalties" << endl;
+    board->print(players.get(), playerCount);
+
+    if (skipTurn(seat))
+    {
+        return;
+    }
+
+    TurnAction action = { ACTION_NONE, 0, PROMPT_CELL };
+    cout << "1. Move" << endl;
+    cout << "2. Place Hurdle" << endl;
+    cout << "3. Buy Helper" << endl;
+    cout << "4. Use Item" << endl;
+    cout << "5. Queue Actions" << endl;
+    cout << "Choice: ";
+    readInput(action.type);
+
+    if (action.type == ACTION_QUEUE)
+    {
+        queueActions(seat);
+        return;
+    }
+    if (action.type == ACTION_PLACE_HURDLE)
+    {
+        cout << "Select hurdle to place:" << endl;
+        cout << "1. Fire (50 pts)" << endl;
+        cout << "2. Snake (30 pts)" << endl;
+        cout << "3. Ghost (20 pts)" << endl;
+        cout << "4. Lion (50 pts + 1 gold)" << endl;
+        cout << "5. Lock (12 silver)" << endl;
+        cout << "Choice: ";
+        readInput(action.choice);
+    }
+    else if (action.type == ACTION_BUY_HELPER)
+    {
+        cout << "Select helper to buy:" << endl;
+        cout << "1. Sword (40 pts)" << endl;
+        cout << "2. Shield (30 pts)" << endl;
+        cout << "3. Water (50 pts)" << endl;
+        cout << "4. Key (12 silver)" << endl;
+        cout << "Choice: ";
+        readInput(action.choice);
+    }
+    else if (action.type == ACTION_USE_ITEM)
+    {
+        player->displayInventory();
+        if (player->invSize == 0)
+        {
+            return;
+        }
+        cout << "Select item to use (1-" << player->invSize << "): ";
+        readInput(action.choice);
+    }
+    applyAction(seat, action);
+}
+void AdventureQuest::queueActions(int seat)
+{
+    cout << "Actions (e.g. m5 fire@30 b2 u1): ";
+    string script;
+    readLine(script);
+    string error;
+    if (!queueScript(seat, script, error))
+    {
+        GameLog::out() << "Invalid action queue: " << error << endl;
+        return;
+    }
+    GameLog::out() << "Queued " << queues[seat].size() << " actions." << endl;
+    if (!runQueuedAction(seat))
+    {
+        board->print(players.get(), playerCount);
+    }
+}
+bool AdventureQuest::queueScript(int seat, const string& script, string& error)
+{
+    if (!queues)
+    {
+        queues = make_unique<ActionQueue[]>(playerCount);
+    }
+    return queues[seat].parse(script, error);
+}
+void AdventureQuest::playQueuedTurn(int seat)
+{
+    Player* player = &players[seat];
+    bool running = false;
+    if (skipTurn(seat))
+    {
+        cancelQueue(seat, player->hasReachedGoalState() ? "goal reached" : "blocked");
+    }
+    else
+    {
+        running = runQueuedAction(seat);
+    }
+    if (!running)
+    {
+        GameLog::out() << endl;
+        player->printStatus();
+        board->print(players.get(), playerCount);
+    }
+}
+bool AdventureQuest::runQueuedAction(int seat)
+{
+    Player* player = &players[seat];
+    ActionQueue& queue = queues[seat];
+    TurnAction action;
+    if (!queue.pop(action))
+    {
+        return false;
+    }
+    GameLog::out() << "Player " << seat + 1 << " queued: " << ActionQueue::describe(action) << " (" << queue.size() << " left)" << endl;
+
+    int nextNum = player->getCurrentNumber() + player->getDirection();
+    bool onBoard = nextNum >= 1 && nextNum <= board->getSize() * board->getSize();
+    bool refused = action.type == ACTION_MOVE && (!onBoard || isOccupied(nextNum));
+    bool hurdleAhead = action.type == ACTION_MOVE && onBoard && isHurdleKind(board->getKind(nextNum));
+    applyAction(seat, action);
+
+    if (refused)
+    {
+        cancelQueue(seat, "move blocked");
+    }
+    else if (hurdleAhead)
+    {
+        cancelQueue(seat, "hurdle hit");
+    }
+    else if (player->isBlocked())
+    {
+        cancelQueue(seat, "blocked");
+    }
+    else if (player->hasReachedGoalState())
+    {
+        queue.clear();
+    }
+    return !queue.isEmpty();
+}
+void AdventureQuest::cancelQueue(int seat, const char* reason)
+{
+    if (!queues[seat].isEmpty())
+    {
+        GameLog::out() << "Player " << seat + 1 << "'s queue cancelled (" << reason << "), " << queues[seat].size() << " actions dropped." << endl;
+        queues[seat].clear();
+    }
+}
+bool AdventureQuest::hasQueuedActions() const
+{
+    if (!queues)
+    {
+        return false;
+    }
+    for (int seat = 0; seat < playerCount; ++seat)
+    {
+        if (!queues[seat].isEmpty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+const Hurdle* movePlayer(Player& player, Board& board, uint8_t* occupancy, int goalNumber)
+{
+    int fromNum = player.getCurrentNumber();
+    int nextNum = fromNum + player.getDirection();
+    occupancy[fromNum]--;
+    player.setPosition(nextNum);
+
+    const Hurdle* hurdle = nullptr;
+    ItemKind kind = board.getKind(nextNum);
+    if (Item* item = Board::prototype(kind))
+    {
+        if (isHurdleKind(kind))
+        {
+            hurdle = static_cast<const Hurdle*>(item);
+            hurdle->applyEffect(player);
+            for (int cell = player.getCurrentNumber(); cell != nextNum && isCellOccupied(occupancy, cell, goalNumber); cell += player.getDirection())
+            {
+                player.setPosition(cell + player.getDirection());
+            }
+        }
+        else
+        {
+            item->interact(player);
+            board.clearCell(nextNum);
+        }
+    }
+    occupancy[player.getCurrentNumber()]++;
+    return hurdle;
+}
+void AdventureQuest::applyAction(int seat, const TurnAction& action)
+{
+    Player* player = &players[seat];
+    if (action.type == ACTION_MOVE)
+    {
+        int fromNum = player->getCurrentNumber();
+        int nextNum = fromNum + player->getDirection();
+
+        if (nextNum < 1 || nextNum > board->getSize() * board->getSize())
+        {
+            GameLog::out() << "Cannot move further!" << endl;
+            return;
+        }
+
+        if (isOccupied(nextNum))
+        {
+            GameLog::out() << "Cell occupied by opponent! Wait for your next turn." << endl;
+            return;
+        }
+
+        int pointsBefore = player->getPoints();
+        const Hurdle* hurdle = movePlayer(*player, *board, occupancy, goalNumber);
+        if (hurdle && observer)
+        {
+            observer->onHurdleHit(seat, *hurdle, nextNum, pointsBefore - player->getPoints(), player->getBlockedTurns(), !player->isBlocked());
+        }
+
+        if (player->getCurrentNumber() == goalNumber)
+        {
+            player->setReachedGoal(true);
+            scheduler.markFinished(seat);
+            GameLog::out() << "Player " << seat + 1 << " has reached the goal (cell " << goalNumber << ")!" << endl;
+            if (observer)
+            {
+                observer->onGoalReached(seat, roundNumber);
+            }
+        }
+    }
+    else if (action.type == ACTION_PLACE_HURDLE)
+    {
+        if (action.choice < 1 || action.choice > HURDLE_KINDS)
+        {
+            GameLog::out() << "Invalid choice!" << endl;
+            return;
+        }
+        const Hurdle* newHurdle = static_cast<const Hurdle*>(Board::prototype(static_cast<ItemKind>(KIND_FIRE + action.choice - 1)));
+        int assetsBefore = player->getAssetValue();
+        int placedCell = newHurdle->place(*player, action.cell);
+        int spent = assetsBefore - player->getAssetValue();
+        if (observer && spent > 0)
+        {
+            observer->onHurdlePlaced(seat, newHurdle->getKind(), placedCell, spent);
+        }
+    }
+    else if (action.type == ACTION_BUY_HELPER)
+    {
+        if (action.choice < 1 || action.choice > HELPER_KINDS)
+        {
+            GameLog::out() << "Invalid choice!" << endl;
+            return;
+        }
+        Helper newHelper(static_cast<ItemKind>(KIND_SWORD + action.choice - 1));
+        int assetsBefore = player->getAssetValue();
+        newHelper.interact(*player);
+        int spent = assetsBefore - player->getAssetValue();
+        if (observer && spent > 0)
+        {
+            observer->onHelperBought(seat, newHelper.getKind(), spent);
+        }
+    }
+    else if (action.type == ACTION_USE_ITEM)
+    {
+        const Item* item = player->getInventoryItem(action.choice - 1);
+        if (!item)
+        {
+            player->useItem(action.choice - 1);
+            return;
+        }
+        ItemKind itemKind = item->getKind();
+        ItemKind hurdleKind = board->getKind(player->getCurrentNumber());
+        if (player->useItem(action.choice - 1) && observer)
+        {
+            observer->onHelperUsed(seat, itemKind, hurdleKind);
+        }
+    }
+}
+void AdventureQuest::stepTurn(int seat, const TurnAction& action)
+{
+    if (!skipTurn(seat))
+    {
+        applyAction(seat, action);
+    }
+}
+void AdventureQuest::replayTurn(int turn, const TurnAction& action)
+{
+    if (turn % playerCount == 0)
+    {
+        beginRound();
+    }
+    stepTurn(turn % playerCount, action);
+}
+void AdventureQuest::writeState(string& out) const
+{
+    auto put = [&](int64_t value)
+    {
+        int32_t word = static_cast<int32_t>(value);
+        out.append(reinterpret_cast<const char*>(&word), sizeof(word));
+    };
+    auto putMask = [&](const BitBoard& mask)
+    {
+        put(static_cast<uint32_t>(mask.lowWord()));
+        put(static_cast<uint32_t>(mask.lowWord() >> 32));
+        put(static_cast<uint32_t>(mask.highWord()));
+        put(static_cast<uint32_t>(mask.highWord() >> 32));
+    };
+    put(currentLevel);
+    put(playerCount);
+    put(static_cast<uint32_t>(seed));
+    put(static_cast<uint32_t>(seed >> 32));
+    put(roundNumber);
+    for (int slot = 0; slot < Board::BOARD_KINDS; ++slot)
+    {
+        putMask(board->items[slot]);
+    }
+    int moves[4 * 11 * 11];
+    for (int p = 0; p < playerCount; ++p)
+    {
+        const Player* player = &players[p];
+        put(player->currentNumber);
+        put(player->gold);
+        put(player->silver);
+        put(player->points);
+        put(player->blockedTurns);
+        put(player->hasReachedGoal ? 1 : 0);
+        putMask(player->path);
+        put(player->invSize);
+        for (int i = 0; i < player->invSize; ++i)
+        {
+            put(player->inventory[i].getKind());
+            put(player->inventory[i].getUses());
+        }
+        int length = player->history.size();
+        int* history = length <= 4 * 11 * 11 ? moves : new int[length];
+        player->history.copyTo(history);
+        put(length);
+        for (int i = 0; i < length; ++i)
+        {
+            out.push_back(static_cast<char>(history[i]));
+        }
+        out.append((sizeof(int32_t) - length % sizeof(int32_t)) % sizeof(int32_t), '\0');
+        if (history != moves)
+        {
+            delete[] history;
+        }
+    }
+}
+bool AdventureQuest::readState(const char* data, size_t size)
+{
+    size_t words = size / sizeof(int32_t);
+    size_t next = 0;
+    auto get = [&]() -> int32_t
+    {
+        int32_t word = 0;
+        if (next < words)
+        {
+            memcpy(&word, data + next * sizeof(int32_t), sizeof(word));
+        }
+        next++;
+        return word;
+    };
+    auto getMask = [&]()
+    {
+        uint64_t low = static_cast<uint32_t>(get());
+        low |= static_cast<uint64_t>(static_cast<uint32_t>(get())) << 32;
+        uint64_t high = static_cast<uint32_t>(get());
+        high |= static_cast<uint64_t>(static_cast<uint32_t>(get())) << 32;
+        return BitBoard(low, high);
+    };
+    int level = get();
+    int count = get();
+    uint64_t stateSeed = static_cast<uint32_t>(get());
+    stateSeed |= static_cast<uint64_t>(static_cast<uint32_t>(get())) << 32;
+    int round = get();
+    if (level < 1 || level > 4 || count != playerCount || round < 0)
+    {
+        return false;
+    }
+    restart(level, stateSeed);
+    roundNumber = round;
+    int totalCells = board->getSize() * board->getSize();
+    BitBoard onBoard = BitBoard::range(1, totalCells);
+    for (int slot = 0; slot < Board::BOARD_KINDS; ++slot)
+    {
+        board->items[slot] = getMask() & onBoard;
+    }
+    for (int p = 0; p < playerCount; ++p)
+    {
+        Player* player = &players[p];
+        int num = get();
+        if (num < 1 || num > totalCells)
+        {
+            return false;
+        }
+        player->currentNumber = num;
+        player->X = board->numberToPosition(num).first;
+        player->Y = board->numberToPosition(num).second;
+        player->gold = get();
+        player->silver = get();
+        player->points = get();
+        player->blockedTurns = max(0, get());
+        player->hasReachedGoal = get() != 0;
+        player->path = getMask() & onBoard;
+        player->invSize = 0;
+        int invSize = get();
+        if (invSize < 0 || invSize > Player::INVENTORY_CAPACITY)
+        {
+            return false;
+        }
+        for (int i = 0; i < invSize; ++i)
+        {
+            int kind = get();
+            int uses = get();
+            if (!isHelperKind(kind))
+            {
+                return false;
+            }
+            player->addItem(Helper(static_cast<ItemKind>(kind), uses));
+        }
+        int length = get();
+        size_t padded = (length + sizeof(int32_t) - 1) / sizeof(int32_t);
+        if (length < 0 || next + padded > words)
+        {
+            return false;
+        }
+        player->history.clear();
+        for (int i = 0; i < length; ++i)
+        {
+            player->history.push(static_cast<uint8_t>(data[next * sizeof(int32_t) + i]));
+        }
+        next += padded;
+    }
+    if (next > words)
+    {
+        return false;
+    }
+    scheduler.reset(players.get());
+    rebuildOccupancy();
+    return true;
+}
+const char* AdventureQuest::checkInvariants() const
+{
+    int totalCells = board->getSize() * board->getSize();
+    int itemCount = 0;
+    for (int slot = 0; slot < Board::BOARD_KINDS; ++slot)
+    {
+        itemCount += board->items[slot].count();
+    }
+    BitBoard occupied = board->occupiedMask();
+    if (itemCount != occupied.count() || (occupied & ~BitBoard::range(1, totalCells)).any())
+    {
+        return "board item masks overlap or leave the board";
+    }
+    if (const char* violation = checkInvariants(scheduler.allSeats()))
+    {
+        return violation;
+    }
+    uint8_t counts[11 * 11 + 1] = {};
+    for (int p = 0; p < playerCount; ++p)
+    {
+        counts[players[p].currentNumber]++;
+    }
+    if (memcmp(counts, occupancy, sizeof(counts)) != 0)
+    {
+        return "occupancy grid out of sync";
+    }
+    return nullptr;
+}
+const char* AdventureQuest::checkInvariants(uint64_t seats) const
+{
+    int totalCells = board->getSize() * board->getSize();
+    if (goalNumber != (totalCells + 1) / 2 || currentLevel != board->getLevel())
+    {
+        return "goal or level out of sync with board";
+    }
+    while (seats)
+    {
+        int p = TurnScheduler::takeNext(seats);
+        const Player* player = &players[p];
+        int num = player->currentNumber;
+        if (player->board != board.get() || player->rules != rules || player->seat != p)
+        {
+            return "player not attached to this game";
+        }
+        if (num < 1 || num > totalCells)
+        {
+            return "player off the board";
+        }
+        auto pos = board->numberToPosition(num);
+        if (pos.first != player->X || pos.second != player->Y)
+        {
+            return "player coordinates disagree with cell number";
+        }
+        if (player->points < 0 || player->gold < 0 || player->silver < 0 || player->blockedTurns < 0)
+        {
+            return "negative player resource";
+        }
+        if (player->invSize < 0 || player->invSize > Player::INVENTORY_CAPACITY)
+        {
+            return "inventory size out of range";
+        }
+        for (int i = 0; i < player->invSize; ++i)
+        {
+            if (!isHelperKind(player->inventory[i].getKind()) || player->inventory[i].getUses() <= 0)
+            {
+                return "inventory slot holds an invalid item";
+            }
+        }
+        if (player->history.size() < 1 || !player->path.test(num))
+        {
+            return "move history lost the current cell";
+        }
+        if (player->hasReachedGoal != ((scheduler.pendingSeats() >> p & 1) == 0))
+        {
+            return "scheduler disagrees with goal state";
+        }
+        if (player->hasReachedGoal && num != goalNumber)
+        {
+            return "finished player left the goal";
+        }
+        if (occupancy[num] == 0)
+        {
+            return "occupancy grid out of sync";
+        }
+        if (occupancy[num] > 1 && num != goalNumber)
+        {
+            return "two players share a cell";
+        }
+    }
+    return nullptr;
+}
+void AdventureQuest::sleepIfBlocked(int seat)
+{
+    Player* player = &players[seat];
+    if (player->isBlocked() && !player->hasReachedGoalState())
+    {
+        scheduler.sleep(seat, roundNumber + player->blockedTurns + 1);
+    }
+}
+void AdventureQuest::wakeSeats()
+{
+    uint64_t seats = scheduler.wake(roundNumber);
+    while (seats)
+    {
+        int seat = TurnScheduler::takeNext(seats);
+        Player* player = &players[seat];
+        GameLog::out() << "Player " << seat + 1 << " was blocked for " << player->blockedTurns << " turns." << endl;
+        if (observer)
+        {
+            observer->onTurnsSkipped(seat, player->blockedTurns);
+        }
+        player->clearBlock();
+    }
+}
+void AdventureQuest::reserveHistory(int moves)
+{
+    for (int p = 0; p < playerCount; ++p)
+    {
+        players[p].history.reserve(moves);
+    }
+}
+int AdventureQuest::getBlockedTurns(int seat) const
+{
+    if ((scheduler.sleepingSeats() >> seat & 1) == 0)
+    {
+        return players[seat].blockedTurns;
+    }
+    int turnsLeftThisRound = seat > roundSeat ? 1 : 0;
+    return max(0, scheduler.getWakeRound(seat) - 1 - roundNumber + turnsLeftThisRound);
+}
+void AdventureQuest::settleBlocked()
+{
+    uint64_t seats = scheduler.sleepingSeats();
+    while (seats)
+    {
+        int seat = TurnScheduler::takeNext(seats);
+        Player* player = &players[seat];
+        int remaining = getBlockedTurns(seat);
+        if (observer && player->blockedTurns > remaining)
+        {
+            observer->onTurnsSkipped(seat, player->blockedTurns - remaining);
+        }
+        player->blockedTurns = remaining;
+    }
+    scheduler.clearSleeping();
+}
+void AdventureQuest::publish()
+{
+    if (publisher)
+    {
+        publisher->publish(*this);
+    }
+}
+void AdventureQuest::startGame()
+{
+    AQ_TRACE_SPAN("startGame");
+    prefetchNextLevel();
+    publish();
+    while (!scheduler.allFinished())
+    {
+        roundNumber++;
+        for (int seat = 0; seat < playerCount; ++seat)
+        {
+            cout << endl;
+            cout << "P" << seat + 1 << ": ";
+            playTurn(seat);
+            publish();
+        }
+
+        if (scheduler.allFinished())
+        {
+            determineWinner();
+            break;
+        }
+        if (hasQueuedActions())
+        {
+            continue;
+        }
+
+        cout << endl;
+        cout << "1. Continue" << endl;
+        cout << "2. Save" << endl;
+        cout << "3. Load" << endl;
+        cout << "Choice: ";
+        int choice;
+        readInput(choice);
+        if (choice == 2)
+        {
+            saveGame();
+        }
+        else if (choice == 3)
+        {
+            loadGame();
+        }
+    }
+}
+int AdventureQuest::runSimulation(Bot* const* bots, int maxRounds)
+{
+    AQ_TRACE_SPAN("runSimulation");
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    if (observer)
+    {
+        observer->onGameStart(*this);
+    }
+    publish();
+
+    uint64_t pending = scheduler.pendingSeats();
+    while (pending)
+    {
+        sleepIfBlocked(TurnScheduler::takeNext(pending));
+    }
+    while (!scheduler.allFinished() && roundNumber < maxRounds)
+    {
+        if (scheduler.actionableSeats() == 0)
+        {
+            roundNumber = min(scheduler.getNextWake(), maxRounds + 1) - 1;
+            if (roundNumber >= maxRounds)
+            {
+                break;
+            }
+        }
+        roundNumber++;
+        wakeSeats();
+        uint64_t seats = scheduler.actionableSeats();
+        while (seats)
+        {
+            int seat = TurnScheduler::takeNext(seats);
+            roundSeat = seat;
+            applyAction(seat, bots[seat]->chooseAction(*this, seat));
+            sleepIfBlocked(seat);
+            publish();
+        }
+        roundSeat = MAX_PLAYERS;
+    }
+    settleBlocked();
+
+    if (observer)
+    {
+        observer->onGameEnd(*this, getWinner(), scheduler.allFinished());
+    }
+    GameLog::setQuiet(wasQuiet);
+    return roundNumber;
+}
+int AdventureQuest::runSimulation(Bot& bot, int maxRounds)
+{
+    Bot* bots[MAX_PLAYERS];
+    for (int seat = 0; seat < playerCount; ++seat)
+    {
+        bots[seat] = &bot;
+    }
+    return runSimulation(bots, maxRounds);
+}
+int AdventureQuest::getWinner() const
+{
+    for (int p = 0; p < playerCount; ++p)
+    {
+        if (!players[p].hasReachedGoalState())
+        {
+            continue;
+        }
+        bool ahead = true;
+        for (int q = 0; q < playerCount && ahead; ++q)
+        {
+            ahead = q == p || players[p].getPoints() > players[q].getPoints();
+        }
+        if (ahead)
+        {
+            return p;
+        }
+    }
+    return -1;
+}
+void AdventureQuest::determineWinner()
+{
+    GameLog::out() << endl;
+    GameLog::out() << "Game Over!" << endl;
+    for (int p = 0; p < playerCount; ++p)
+    {
+        GameLog::out() << "Player " << p + 1 << " Points: " << players[p].getPoints() << endl;
+    }
+
+    int winner = getWinner();
+    if (winner >= 0)
+    {
+        GameLog::out() << "Player " << winner + 1 << " wins!" << endl;
+    }
+    else
+    {
+        GameLog::out() << "It's a draw!" << endl;
+    }
+}
+void AdventureQuest::levelUp()
+{
+    AQ_TRACE_SPAN("levelUp");
+    if (currentLevel >= 4)
+    {
+        GameLog::out() << "Maximum level reached!" << endl;
+        return;
+    }
+
+    currentLevel++;
+    if (unique_ptr<Board> next = takeNextBoard())
+    {
+        board = move(next);
+    }
+    else
+    {
+        board->reset(currentLevel, levelSeed(currentLevel));
+    }
+    roundNumber = 0;
+    roundSeat = MAX_PLAYERS;
+    queues.reset();
+
+    int totalCells = board->getSize() * board->getSize();
+    goalNumber = (totalCells + 1) / 2;
+
+    for (int p = 0; p < playerCount; ++p)
+    {
+        players[p].board = board.get();
+        players[p].levelUp(startCell(p, playerCount, totalCells));
+    }
+    scheduler.reset(players.get());
+    rebuildOccupancy();
+    publish();
+
+    GameLog::out() << "Level Up! Now playing on " << board->getSize() << "x" << board->getSize() << " board!" << endl;
+}
+void AdventureQuest::restart(int level, uint64_t seed)
+{
+    discardNextBoard();
+    discardSavedGame();
+    this->seed = seed;
+    currentLevel = level;
+    board->reset(currentLevel, levelSeed(currentLevel));
+    restartPlayers();
+}
+void AdventureQuest::restart(const Board& start)
+{
+    discardNextBoard();
+    discardSavedGame();
+    seed = start.getSeed();
+    currentLevel = start.getLevel();
+    *board = start;
+    restartPlayers();
+}
+void AdventureQuest::restartPlayers()
+{
+    roundNumber = 0;
+    queues.reset();
+    int totalCells = board->getSize() * board->getSize();
+    goalNumber = (totalCells + 1) / 2;
+
+    for (int p = 0; p < playerCount; ++p)
+    {
+        players[p].board = board.get();
+        players[p].restart(startCell(p, playerCount, totalCells), currentLevel);
+    }
+    scheduler.reset(players.get());
+    rebuildOccupancy();
+    publish();
+}
+RandomBot::RandomBot(uint64_t seed, int hurdleRate, int helperRate) : rng(seed), hurdleRate(hurdleRate), helperRate(helperRate) {}
+TurnAction RandomBot::chooseAction(const AdventureQuest& game, int seat)
+{
+    const Player& self = game.getPlayer(seat);
+    TurnAction action = { ACTION_MOVE, 0, 0 };
+    int roll = rng.nextInt(100);
+    if (roll < hurdleRate && self.getPoints() >= 20)
+    {
+        int target = rng.nextInt(game.getPlayerCount() - 1);
+        const Player& opponent = game.getPlayer(target >= seat ? target + 1 : target);
+        int ahead = 1 + rng.nextInt(3);
+        int cell = opponent.getCurrentNumber() + opponent.getDirection() * ahead;
+        int totalCells = game.getBoard().getSize() * game.getBoard().getSize();
+        if (!opponent.hasReachedGoalState() && cell >= 1 && cell <= totalCells && cell != game.getGoalNumber())
+        {
+            action.type = ACTION_PLACE_HURDLE;
+            action.choice = 1 + rng.nextInt(HURDLE_KINDS);
+            action.cell = cell;
+        }
+    }
+    else if (roll < hurdleRate + helperRate && self.getPoints() >= 30)
+    {
+        action.type = ACTION_BUY_HELPER;
+        action.choice = 1 + rng.nextInt(HELPER_KINDS);
+    }
+    return action;
+}
+void RunningStat::add(double x)
+{
+    count++;
+    double delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+ColumnarWriter::ColumnarWriter(const string& path, const char* const* columnNames, int columnCount, int blockRows) : file(path, ios::binary), columnCount(columnCount), blockRows(blockRows), rowsInBlock(0), totalRows(0)
+{
+    buffer = new int64_t[columnCount * blockRows];
+    if (!file)
+    {
+        return;
+    }
+    file.write("AQCOL1\0\0", 8);
+    int32_t header[2] = { columnCount, blockRows };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (int c = 0; c < columnCount; ++c)
+    {
+        uint16_t length = static_cast<uint16_t>(string(columnNames[c]).size());
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(columnNames[c], length);
+    }
+}
+ColumnarWriter::~ColumnarWriter()
+{
+    close();
+    delete[] buffer;
+}
+void ColumnarWriter::writeRow(const int64_t* values)
+{
+    for (int c = 0; c < columnCount; ++c)
+    {
+        buffer[c * blockRows + rowsInBlock] = values[c];
+    }
+    rowsInBlock++;
+    totalRows++;
+    if (rowsInBlock == blockRows)
+    {
+        flushBlock();
+    }
+}
+void ColumnarWriter::flushBlock()
+{
+    if (rowsInBlock == 0 || !file.is_open())
+    {
+        return;
+    }
+    int32_t rows = rowsInBlock;
+    file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    for (int c = 0; c < columnCount; ++c)
+    {
+        file.write(reinterpret_cast<const char*>(buffer + c * blockRows), rowsInBlock * sizeof(int64_t));
+    }
+    rowsInBlock = 0;
+}
+void ColumnarWriter::close()
+{
+    if (!file.is_open())
+    {
+        return;
+    }
+    flushBlock();
+    int32_t terminator = 0;
+    int64_t rows = totalRows;
+    file.write(reinterpret_cast<const char*>(&terminator), sizeof(terminator));
+    file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    file.close();
+}
+const char* const* BalanceAnalytics::columnNames()
+{
+    static const char* const GAME_NAMES[GAME_COLUMNS] = { "seed", "level", "players", "winner", "finished", "rounds", "purchases" };
+    static string seatNames[SEAT_COLUMNS * MAX_SEATS];
+    static const char* names[MAX_COLUMNS];
+    static once_flag built;
+    call_once(built, []()
+    {
+        copy(GAME_NAMES, GAME_NAMES + GAME_COLUMNS, names);
+        for (int s = 0; s < MAX_SEATS; ++s)
+        {
+            seatNames[SEAT_COLUMNS * s] = "p" + to_string(s + 1) + "_points";
+            seatNames[SEAT_COLUMNS * s + 1] = "p" + to_string(s + 1) + "_goal_round";
+        }
+        for (int c = 0; c < SEAT_COLUMNS * MAX_SEATS; ++c)
+        {
+            names[GAME_COLUMNS + c] = seatNames[c].c_str();
+        }
+    });
+    return names;
+}
+BalanceAnalytics::BalanceAnalytics(ColumnarWriter* columns, int seatColumns) : columns(columns), seatColumns(max(2, min(seatColumns, MAX_SEATS))), rules(&DEFAULT_RULES), gameLevel(1), seatsThisGame(2), gamesPlayed(0), timeouts(0), seatsSeen(0)
+{
+    for (int k = 0; k < HURDLE_KINDS; ++k)
+    {
+        hurdlePlacements[k] = 0;
+        hurdleHits[k] = 0;
+        hurdleNeutralized[k] = 0;
+        hurdlePenalty[k] = 0;
+        hurdleBlockTurns[k] = 0;
+    }
+    for (int k = 0; k < HELPER_KINDS; ++k)
+    {
+        helperPurchases[k] = 0;
+        helperNeutralizations[k] = 0;
+        helperManualUses[k] = 0;
+    }
+}
+void BalanceAnalytics::onGameStart(const AdventureQuest& game)
+{
+    rules = &game.getRules();
+    gameLevel = game.getBoardLevel();
+    seatsThisGame = game.getPlayerCount();
+    seatsSeen = max(seatsSeen, seatsThisGame);
+    for (int i = 0; i <= MAX_CELLS; ++i)
+    {
+        cellPlacer[i] = -1;
+    }
+    for (int k = 0; k < HURDLE_KINDS; ++k)
+    {
+        hurdleSpent[k] = 0;
+        hurdleInflicted[k] = 0;
+    }
+    for (int k = 0; k < HELPER_KINDS; ++k)
+    {
+        helperSpent[k] = 0;
+        helperAvoided[k] = 0;
+    }
+    for (int seat = 0; seat < MAX_SEATS; ++seat)
+    {
+        goalRound[seat] = -1;
+    }
+    hurdlesThisGame = 0;
+    helpersThisGame = 0;
+}
+void BalanceAnalytics::onHurdlePlaced(int seat, ItemKind kind, int cell, int spent)
+{
+    int k = kind - KIND_FIRE;
+    hurdleSpent[k] += spent;
+    if (cell >= 1 && cell <= MAX_CELLS)
+    {
+        cellPlacer[cell] = seat;
+        hurdlePlacements[k]++;
+        hurdlesThisGame++;
+    }
+}
+void BalanceAnalytics::onHurdleHit(int seat, const Hurdle& hurdle, int cell, int pointsLost, int blockedTurns, bool neutralized)
+{
+    int k = hurdle.getKind() - KIND_FIRE;
+    hurdleHits[k]++;
+    hurdlePenalty[k] += pointsLost;
+    hurdleBlockTurns[k] += blockedTurns;
+    if (cell >= 1 && cell <= MAX_CELLS && cellPlacer[cell] >= 0)
+    {
+        hurdleInflicted[k] += cellPlacer[cell] == seat ? -pointsLost : pointsLost;
+    }
+    if (neutralized)
+    {
+        hurdleNeutralized[k]++;
+        const HurdleRule& rule = rules->hurdle(hurdle.getKind());
+        int h = rule.neutralizer - KIND_SWORD;
+        helperNeutralizations[h]++;
+        helperAvoided[h] += rule.penalty;
+    }
+}
+void BalanceAnalytics::onHelperBought(int /*seat*/, ItemKind kind, int spent)
+{
+    helperSpent[kind - KIND_SWORD] += spent;
+    helperPurchases[kind - KIND_SWORD]++;
+    helpersThisGame++;
+}
+void BalanceAnalytics::onHelperUsed(int /*seat*/, ItemKind kind, ItemKind /*hurdleKind*/)
+{
+    if (kind >= KIND_SWORD && kind <= KIND_KEY)
+    {
+        helperManualUses[kind - KIND_SWORD]++;
+    }
+}
+void BalanceAnalytics::onGoalReached(int seat, int round)
+{
+    goalRound[seat] = round;
+}
+void BalanceAnalytics::onGameEnd(const AdventureQuest& game, int winner, bool finished)
+{
+    gamesPlayed++;
+    if (!finished)
+    {
+        timeouts++;
+    }
+    drawRate[gameLevel].add(finished && winner < 0 ? 1.0 : 0.0);
+    timeoutRate[gameLevel].add(finished ? 0.0 : 1.0);
+    for (int s = 0; s < seatsThisGame; ++s)
+    {
+        winRate[gameLevel][s].add(winner == s ? 1.0 : 0.0);
+        if (goalRound[s] >= 0)
+        {
+            turnsToGoal[gameLevel][s].add(goalRound[s]);
+        }
+    }
+    for (int k = 0; k < HURDLE_KINDS; ++k)
+    {
+        if (hurdleSpent[k] > 0)
+        {
+            hurdleReturn[k].add(static_cast<double>(hurdleInflicted[k] - hurdleSpent[k]) / hurdleSpent[k]);
+        }
+    }
+    for (int k = 0; k < HELPER_KINDS; ++k)
+    {
+        if (helperSpent[k] > 0)
+        {
+            helperReturn[k].add(static_cast<double>(helperAvoided[k] - helperSpent[k]) / helperSpent[k]);
+        }
+    }
+
+    if (columns)
+    {
+        int64_t row[MAX_COLUMNS] = { static_cast<int64_t>(game.getSeed()), gameLevel, seatsThisGame, winner + 1, finished ? 1 : 0, game.getRound(), hurdlesThisGame + helpersThisGame };
+        for (int s = 0; s < seatColumns; ++s)
+        {
+            row[GAME_COLUMNS + SEAT_COLUMNS * s] = s < seatsThisGame ? game.getPlayer(s).getPoints() : -1;
+            row[GAME_COLUMNS + SEAT_COLUMNS * s + 1] = s < seatsThisGame ? goalRound[s] : -1;
+        }
+        columns->writeRow(row);
+    }
+}
+bool BalanceAnalytics::writeSummary(const string& path) const
+{
+    static const char* const HURDLE_NAMES[HURDLE_KINDS] = { "Fire", "Snake", "Ghost", "Lion", "Lock" };
+    static const char* const HELPER_NAMES[HELPER_KINDS] = { "Sword", "Shield", "Water", "Key" };
+    ofstream csv(path);
+    if (!csv)
+    {
+        return false;
+    }
+    auto row = [&csv](const string& metric, const string& group, const RunningStat& stat)
+    {
+        double half = stat.getHalfWidth95();
+        csv << metric << "," << group << "," << stat.getCount() << "," << stat.getMean() << "," << stat.getMean() - half << "," << stat.getMean() + half << ",\n";
+    };
+    auto count = [&csv](const string& metric, const string& group, long long total)
+    {
+        csv << metric << "," << group << ",,,,," << total << "\n";
+    };
+    auto sum = [&csv](const string& metric, const string& group, long long samples, long long total)
+    {
+        csv << metric << "," << group << "," << samples << ",";
+        if (samples > 0)
+        {
+            csv << static_cast<double>(total) / samples;
+        }
+        csv << ",,," << total << "\n";
+    };
+
+    csv << "metric,group,samples,mean,ci95_low,ci95_high,total\n";
+    count("games", "all", gamesPlayed);
+    count("timeouts", "all", timeouts);
+    for (int level = 1; level <= 4; ++level)
+    {
+        if (drawRate[level].getCount() == 0)
+        {
+            continue;
+        }
+        string group = "level" + to_string(level);
+        for (int s = 0; s < seatsSeen; ++s)
+        {
+            row("win_rate", group + "_p" + to_string(s + 1), winRate[level][s]);
+        }
+        row("draw_rate", group, drawRate[level]);
+        row("timeout_rate", group, timeoutRate[level]);
+        for (int s = 0; s < seatsSeen; ++s)
+        {
+            row("turns_to_goal", group + "_p" + to_string(s + 1), turnsToGoal[level][s]);
+        }
+    }
+    for (int k = 0; k < HURDLE_KINDS; ++k)
+    {
+        row("hurdle_roi", HURDLE_NAMES[k], hurdleReturn[k]);
+        count("hurdle_placements", HURDLE_NAMES[k], hurdlePlacements[k]);
+        count("hurdle_hits", HURDLE_NAMES[k], hurdleHits[k]);
+        count("hurdle_neutralized", HURDLE_NAMES[k], hurdleNeutralized[k]);
+        sum("hurdle_penalty", HURDLE_NAMES[k], hurdleHits[k], hurdlePenalty[k]);
+        sum("hurdle_block_turns", HURDLE_NAMES[k], hurdleHits[k], hurdleBlockTurns[k]);
+    }
+    for (int k = 0; k < HELPER_KINDS; ++k)
+    {
+        row("helper_roi", HELPER_NAMES[k], helperReturn[k]);
+        count("helper_purchases", HELPER_NAMES[k], helperPurchases[k]);
+        count("helper_neutralizations", HELPER_NAMES[k], helperNeutralizations[k]);
+        count("helper_manual_uses", HELPER_NAMES[k], helperManualUses[k]);
+    }
+    return static_cast<bool>(csv);
+}
+string readOption(int argc, char* argv[], const string& name, const string& fallback)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (name == argv[i])
+        {
+            return argv[i + 1];
+        }
+    }
+    return fallback;
+}
+template <typename T>
+T readNumber(int argc, char* argv[], const string& name, const string& fallback, bool& valid)
+{
+    string text = readOption(argc, argv, name, fallback);
+    T value = T();
+    from_chars_result result = from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != errc() || result.ptr != text.data() + text.size())
+    {
+        cout << "Invalid value for " << name << endl;
+        valid = false;
+    }
+    return value;
+}
+Bot* makeBot(const string& name, uint64_t seed, int budgetMs, int maxDepth)
+{
+    if (name == "random")
+    {
+        return new RandomBot(seed);
+    }
+    if (name == "evolved")
+    {
+        return new PolicyBot(EVOLVED_POLICY, seed);
+    }
+    if (name == "search")
+    {
+        return new SearchBot(budgetMs, maxDepth);
+    }
+    if (name == "move")
+    {
+        return new MoveBot();
+    }
+    return nullptr;
+}
+bool openPublisher(int argc, char* argv[], StatePublisher& publisher)
+{
+    string name = readOption(argc, argv, "--publish", "");
+    string error;
+    if (!name.empty() && !publisher.open(name, error))
+    {
+        cout << "Cannot publish: " << error << endl;
+        return false;
+    }
+    return true;
+}
+int runAnalytics(int argc, char* argv[])
+{
+    bool valid = true;
+    long long games = readNumber<long long>(argc, argv, "--games", "100000", valid);
+    int level = readNumber<int>(argc, argv, "--level", "0", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    int maxRounds = readNumber<int>(argc, argv, "--max-rounds", "1000", valid);
+    string prefix = readOption(argc, argv, "--out", "analytics");
+    int playerCount = readNumber<int>(argc, argv, "--players", "2", valid);
+    int budget = readNumber<int>(argc, argv, "--budget", "20", valid);
+    int depth = readNumber<int>(argc, argv, "--depth", "32", valid);
+    string botList = readOption(argc, argv, "--bot", "random");
+    if (!valid)
+    {
+        return 1;
+    }
+    string botNames[AdventureQuest::MAX_PLAYERS];
+    int botCount = 0;
+    for (size_t start = 0; start <= botList.size() && botCount < AdventureQuest::MAX_PLAYERS; ++botCount)
+    {
+        size_t comma = min(botList.find(',', start), botList.size());
+        botNames[botCount] = botList.substr(start, comma - start);
+        start = comma + 1;
+        Bot* probe = makeBot(botNames[botCount], 0, budget, depth);
+        if (!probe)
+        {
+            cout << "Unknown bot " << botNames[botCount] << "!" << endl;
+            return 1;
+        }
+        delete probe;
+    }
+
+    int seatColumns = max(2, min(playerCount, AdventureQuest::MAX_PLAYERS));
+    ColumnarWriter columns(prefix + ".aqcol", BalanceAnalytics::columnNames(), BalanceAnalytics::columnCount(seatColumns));
+    if (!columns.isOpen())
+    {
+        cout << "Cannot open " << prefix << ".aqcol for writing!" << endl;
+        return 1;
+    }
+    StatePublisher publisher;
+    if (!openPublisher(argc, argv, publisher))
+    {
+        return 1;
+    }
+    BoardPack pack;
+    string packPath = readOption(argc, argv, "--pack", "");
+    string error;
+    if (!packPath.empty() && !pack.open(packPath, error))
+    {
+        cout << error << "!" << endl;
+        return 1;
+    }
+    for (int l = 1; l <= 4 && pack.isOpen(); ++l)
+    {
+        if ((level < 1 || level > 4 || level == l) && pack.getCount(l) == 0)
+        {
+            cout << packPath << " has no level " << l << " boards!" << endl;
+            return 1;
+        }
+    }
+    unique_ptr<AdventureQuest> packGames[4];
+    Board packBoard(1, 0);
+    BalanceAnalytics analytics(&columns, seatColumns);
+    for (long long i = 0; i < games; ++i)
+    {
+        uint64_t gameSeed = Rng::mix(seed, static_cast<uint64_t>(i));
+        int gameLevel = level >= 1 && level <= 4 ? level : 1 + static_cast<int>(i % 4);
+        unique_ptr<AdventureQuest> generated;
+        AdventureQuest* current;
+        if (pack.isOpen())
+        {
+            unique_ptr<AdventureQuest>& reused = packGames[gameLevel - 1];
+            if (!reused)
+            {
+                reused = make_unique<AdventureQuest>(gameLevel, gameSeed, playerCount);
+            }
+            long long index = level >= 1 && level <= 4 ? i : i / 4;
+            pack.load(gameLevel, index % pack.getCount(gameLevel), packBoard);
+            reused->restart(packBoard);
+            current = reused.get();
+        }
+        else
+        {
+            generated = make_unique<AdventureQuest>(gameLevel, gameSeed, playerCount);
+            current = generated.get();
+        }
+        AdventureQuest& game = *current;
+        game.setObserver(&analytics);
+        game.setPublisher(publisher.isOpen() ? &publisher : nullptr);
+        Bot* pool[AdventureQuest::MAX_PLAYERS];
+        Bot* bots[AdventureQuest::MAX_PLAYERS];
+        for (int b = 0; b < botCount; ++b)
+        {
+            pool[b] = makeBot(botNames[b], Rng::mix(gameSeed, 1 + b), budget, depth);
+        }
+        for (int seat = 0; seat < game.getPlayerCount(); ++seat)
+        {
+            bots[seat] = pool[seat % botCount];
+        }
+        game.runSimulation(bots, maxRounds);
+        for (int b = 0; b < botCount; ++b)
+        {
+            delete pool[b];
+        }
+    }
+    columns.close();
+    if (!analytics.writeSummary(prefix + ".csv"))
+    {
+        cout << "Cannot write " << prefix << ".csv!" << endl;
+        return 1;
+    }
+    cout << "Simulated " << analytics.getGamesPlayed() << " games -> " << prefix << ".aqcol, " << prefix << ".csv" << endl;
+    return 0;
+}
+int runCampaign(int argc, char* argv[])
+{
+    bool valid = true;
+    long long campaigns = readNumber<long long>(argc, argv, "--games", "10000", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    int maxRounds = readNumber<int>(argc, argv, "--max-rounds", "1000", valid);
+    int playerCount = readNumber<int>(argc, argv, "--players", "2", valid);
+    int budget = readNumber<int>(argc, argv, "--budget", "20", valid);
+    int depth = readNumber<int>(argc, argv, "--depth", "32", valid);
+    string botList = readOption(argc, argv, "--bot", "random");
+    if (!valid)
+    {
+        return 1;
+    }
+
+    AdventureQuest game(1, seed, playerCount);
+    playerCount = game.getPlayerCount();
+    Bot* pool[AdventureQuest::MAX_PLAYERS];
+    Bot* bots[AdventureQuest::MAX_PLAYERS];
+    int botCount = 0;
+    for (size_t start = 0; start <= botList.size() && botCount < AdventureQuest::MAX_PLAYERS; ++botCount)
+    {
+        size_t comma = min(botList.find(',', start), botList.size());
+        string name = botList.substr(start, comma - start);
+        start = comma + 1;
+        pool[botCount] = makeBot(name, Rng::mix(seed, 1 + botCount), budget, depth);
+        if (!pool[botCount])
+        {
+            cout << "Unknown bot " << name << "!" << endl;
+            for (int b = 0; b < botCount; ++b)
+            {
+                delete pool[b];
+            }
+            return 1;
+        }
+    }
+    for (int seat = 0; seat < playerCount; ++seat)
+    {
+        bots[seat] = pool[seat % botCount];
+    }
+    game.reserveHistory(4 * maxRounds + 11 * 11);
+
+    long long rounds[4] = {};
+    long long finished[4] = {};
+    long long draws[4] = {};
+    long long* wins = new long long[4 * playerCount]();
+    long long* points = new long long[4 * playerCount]();
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    GameLog::out() << flush;
+#ifdef AQ_COUNT_ALLOCATIONS
+    long long startupAllocations = heapAllocations.load();
+#endif
+    auto started = chrono::steady_clock::now();
+    for (long long c = 0; c < campaigns; ++c)
+    {
+        game.restart(1, Rng::mix(seed, static_cast<uint64_t>(c)));
+        for (int level = 0; level < 4; ++level)
+        {
+            if (level > 0)
+            {
+                game.levelUp();
+            }
+            rounds[level] += game.runSimulation(bots, maxRounds);
+            finished[level] += game.isFinished() ? 1 : 0;
+            int winner = game.getWinner();
+            if (winner < 0)
+            {
+                draws[level]++;
+            }
+            else
+            {
+                wins[level * playerCount + winner]++;
+            }
+            for (int seat = 0; seat < playerCount; ++seat)
+            {
+                points[level * playerCount + seat] += game.getPlayer(seat).getPoints();
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+#ifdef AQ_COUNT_ALLOCATIONS
+    long long campaignAllocations = heapAllocations.load() - startupAllocations;
+#endif
+    GameLog::setQuiet(wasQuiet);
+
+    cout << "Played " << campaigns << " campaigns with " << playerCount << " players in " << fixed << setprecision(2) << seconds << " s" << endl;
+    cout << left << setw(7) << "Level" << setw(8) << "Board" << setw(12) << "Rounds" << setw(10) << "Finished" << setw(8) << "Draws";
+    for (int seat = 0; seat < playerCount; ++seat)
+    {
+        cout << setw(10) << "P" + to_string(seat + 1) + " wins" << setw(12) << "P" + to_string(seat + 1) + " points";
+    }
+    cout << endl;
+    double perCampaign = campaigns > 0 ? 1.0 / campaigns : 0.0;
+    for (int level = 0; level < 4; ++level)
+    {
+        int size = 5 + 2 * level;
+        cout << setw(7) << level + 1 << setw(8) << to_string(size) + "x" + to_string(size) << setw(12) << setprecision(1) << rounds[level] * perCampaign;
+        cout << setw(10) << setprecision(3) << finished[level] * perCampaign << setw(8) << draws[level] * perCampaign;
+        for (int seat = 0; seat < playerCount; ++seat)
+        {
+            cout << setw(10) << setprecision(3) << wins[level * playerCount + seat] * perCampaign << setw(12) << setprecision(1) << points[level * playerCount + seat] * perCampaign;
+        }
+        cout << endl;
+    }
+    cout << right;
+#ifdef AQ_COUNT_ALLOCATIONS
+    cout << "Heap allocations after startup: " << campaignAllocations << endl;
+#endif
+
+    delete[] wins;
+    delete[] points;
+    for (int b = 0; b < botCount; ++b)
+    {
+        delete pool[b];
+    }
+    return 0;
+}
+ReplayWriter::~ReplayWriter()
+{
+    delete[] index;
+    delete[] keyframeOffsets;
+}
+bool ReplayWriter::open(const string& prefix, int interval, string& error)
+{
+    data.open(prefix + ".aqr", ios::binary | ios::trunc);
+    if (!data)
+    {
+        error = "Cannot open " + prefix + ".aqr for writing";
+        return false;
+    }
+    data.write(reinterpret_cast<const char*>(&DATA_MAGIC), sizeof(DATA_MAGIC));
+    offset = sizeof(DATA_MAGIC);
+    indexPath = prefix + ".aqi";
+    this->interval = max(1, interval);
+    return true;
+}
+int ReplayWriter::addGame(uint64_t id, AdventureQuest& game, Bot* const* bots, int maxRounds)
+{
+    int playerCount = game.getPlayerCount();
+    decisions.clear();
+    keyframes.clear();
+    int keyframeCount = 0;
+    auto addKeyframe = [&]()
+    {
+        if (keyframeCount == keyframeCapacity)
+        {
+            keyframeCapacity = max(64, 2 * keyframeCapacity);
+            uint64_t* grown = new uint64_t[keyframeCapacity];
+            copy(keyframeOffsets, keyframeOffsets + keyframeCount, grown);
+            delete[] keyframeOffsets;
+            keyframeOffsets = grown;
+        }
+        size_t sizeAt = keyframes.size();
+        keyframeOffsets[keyframeCount++] = sizeAt;
+        keyframes.append(sizeof(int32_t), '\0');
+        game.writeState(keyframes);
+        int32_t length = static_cast<int32_t>(keyframes.size() - sizeAt - sizeof(int32_t));
+        memcpy(&keyframes[sizeAt], &length, sizeof(length));
+    };
+    int turn = 0;
+    for (; !game.isFinished() && (turn % playerCount != 0 || game.getRound() < maxRounds); ++turn)
+    {
+        if (turn % interval == 0)
+        {
+            addKeyframe();
+        }
+        int seat = turn % playerCount;
+        const Player& player = game.getPlayer(seat);
+        TurnAction action = { ACTION_NONE, 0, 0 };
+        if (!player.isBlocked() && !player.hasReachedGoalState())
+        {
+            action = bots[seat]->chooseAction(game, seat);
+        }
+        decisions.push_back(static_cast<char>(action.type << 4 | (action.choice & 15)));
+        decisions.push_back(static_cast<char>(action.cell));
+        game.replayTurn(turn, action);
+    }
+    if (keyframeCount == 0)
+    {
+        addKeyframe();
+    }
+
+    ReplayHeader header = { id, game.getSeed(), game.getBoardLevel(), playerCount, turn, interval, keyframeCount, 0 };
+    uint64_t keyframeBase = sizeof(header) + keyframeCount * sizeof(uint64_t) + decisions.size();
+    for (int k = 0; k < keyframeCount; ++k)
+    {
+        keyframeOffsets[k] += keyframeBase;
+    }
+    record.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    record.append(reinterpret_cast<const char*>(keyframeOffsets), keyframeCount * sizeof(uint64_t));
+    record += decisions;
+    record += keyframes;
+    data.write(record.data(), record.size());
+
+    if (gameCount == capacity)
+    {
+        capacity = max(1024LL, 2 * capacity);
+        ReplayIndexEntry* grown = new ReplayIndexEntry[capacity];
+        copy(index, index + gameCount, grown);
+        delete[] index;
+        index = grown;
+    }
+    index[gameCount++] = { id, offset };
+    offset += record.size();
+    return turn;
+}
+bool ReplayWriter::close(string& error)
+{
+    data.close();
+    if (!data)
+    {
+        error = "Cannot write replay data";
+        return false;
+    }
+    stable_sort(index, index + gameCount, [](const ReplayIndexEntry& a, const ReplayIndexEntry& b) { return a.id < b.id; });
+    ofstream out(indexPath, ios::binary | ios::trunc);
+    uint64_t count = static_cast<uint64_t>(gameCount);
+    out.write(reinterpret_cast<const char*>(&INDEX_MAGIC), sizeof(INDEX_MAGIC));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(index), gameCount * sizeof(ReplayIndexEntry));
+    out.close();
+    if (!out)
+    {
+        error = "Cannot write " + indexPath;
+        return false;
+    }
+    return true;
+}
+bool ReplayReader::open(const string& prefix, string& error)
+{
+    ifstream in(prefix + ".aqi", ios::binary);
+    uint64_t magic = 0;
+    uint64_t count = 0;
+    if (!in.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || !in.read(reinterpret_cast<char*>(&count), sizeof(count)) || magic != ReplayWriter::INDEX_MAGIC)
+    {
+        error = "Cannot read index " + prefix + ".aqi";
+        return false;
+    }
+    error_code ec;
+    uintmax_t size = filesystem::file_size(prefix + ".aqi", ec);
+    if (ec || count > (size - 2 * sizeof(uint64_t)) / sizeof(ReplayIndexEntry))
+    {
+        error = prefix + ".aqi is truncated";
+        return false;
+    }
+    delete[] index;
+    index = new ReplayIndexEntry[count];
+    gameCount = static_cast<long long>(count);
+    if (!in.read(reinterpret_cast<char*>(index), count * sizeof(ReplayIndexEntry)))
+    {
+        error = prefix + ".aqi is truncated";
+        gameCount = 0;
+        return false;
+    }
+    for (long long i = 1; i < gameCount; ++i)
+    {
+        if (index[i].id <= index[i - 1].id)
+        {
+            error = prefix + ".aqi is not sorted by game id";
+            gameCount = 0;
+            return false;
+        }
+    }
+
+    data.open(prefix + ".aqr", ios::binary);
+    if (!data.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != ReplayWriter::DATA_MAGIC)
+    {
+        error = "Cannot read replays " + prefix + ".aqr";
+        return false;
+    }
+    return true;
+}
+bool ReplayReader::readHeader(uint64_t id, ReplayHeader& header, uint64_t& recordOffset)
+{
+    const ReplayIndexEntry* entry = lower_bound(index, index + gameCount, id, [](const ReplayIndexEntry& e, uint64_t value) { return e.id < value; });
+    if (entry == index + gameCount || entry->id != id)
+    {
+        return false;
+    }
+    recordOffset = entry->offset;
+    data.clear();
+    data.seekg(static_cast<streamoff>(recordOffset));
+    return static_cast<bool>(data.read(reinterpret_cast<char*>(&header), sizeof(header))) && header.id == id && header.turns >= 0 && header.keyframes > 0 && header.interval > 0;
+}
+bool ReplayReader::seek(uint64_t id, int turn, AdventureQuest& game, string& error, bool fromStart)
+{
+    ReplayHeader header;
+    uint64_t recordOffset;
+    if (!readHeader(id, header, recordOffset))
+    {
+        error = "Game " + to_string(id) + " not found";
+        return false;
+    }
+    turn = max(0, min(turn, header.turns));
+    int keyframe = fromStart ? 0 : min(turn / header.interval, header.keyframes - 1);
+    int first = keyframe * header.interval;
+
+    uint64_t keyframeOffset;
+    data.seekg(static_cast<streamoff>(recordOffset + sizeof(header) + keyframe * sizeof(uint64_t)));
+    data.read(reinterpret_cast<char*>(&keyframeOffset), sizeof(keyframeOffset));
+    int32_t length = 0;
+    data.seekg(static_cast<streamoff>(recordOffset + keyframeOffset));
+    data.read(reinterpret_cast<char*>(&length), sizeof(length));
+    if (!data || length < 0 || length > (1 << 24))
+    {
+        error = "Game " + to_string(id) + " has a corrupt keyframe";
+        return false;
+    }
+    buffer.resize(length);
+    data.read(&buffer[0], buffer.size());
+    if (!data)
+    {
+        error = "Game " + to_string(id) + " has a truncated keyframe";
+        return false;
+    }
+    if (game.getPlayerCount() != header.players)
+    {
+        game = AdventureQuest(header.level, header.seed, header.players);
+    }
+    if (game.getPlayerCount() != header.players || !game.readState(buffer.data(), buffer.size()))
+    {
+        error = "Game " + to_string(id) + " has a corrupt keyframe";
+        return false;
+    }
+
+    buffer.resize(2 * static_cast<size_t>(turn - first));
+    data.seekg(static_cast<streamoff>(recordOffset + sizeof(header) + header.keyframes * sizeof(uint64_t) + 2 * static_cast<uint64_t>(first)));
+    data.read(&buffer[0], buffer.size());
+    if (!data)
+    {
+        error = "Game " + to_string(id) + " has truncated decisions";
+        return false;
+    }
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    for (int t = first; t < turn; ++t)
+    {
+        uint8_t packed = static_cast<uint8_t>(buffer[2 * (t - first)]);
+        TurnAction action = { packed >> 4, packed & 15, static_cast<int8_t>(buffer[2 * (t - first) + 1]) };
+        game.replayTurn(t, action);
+    }
+    GameLog::setQuiet(wasQuiet);
+    return true;
+}
+PackedBoard BoardPack::pack(const Board& board)
+{
+    PackedBoard packed;
+    packed.seed = board.getSeed();
+    packed.hash = 0xcbf29ce484222325ULL ^ static_cast<uint64_t>(board.getLevel());
+    for (int slot = 0; slot < Board::BOARD_KINDS; ++slot)
+    {
+        packed.masks[slot][0] = board.items[slot].lowWord();
+        packed.masks[slot][1] = board.items[slot].highWord();
+        for (int w = 0; w < 2; ++w)
+        {
+            packed.hash = (packed.hash ^ packed.masks[slot][w]) * 0x100000001b3ULL;
+            packed.hash ^= packed.hash >> 29;
+        }
+    }
+    return packed;
+}
+bool BoardPack::generate(const string& path, long long perLevel, uint64_t seed, int itemDensity, long long* uniqueCounts, string& error)
+{
+    auto before = [](const PackedBoard& a, const PackedBoard& b)
+    {
+        return a.hash != b.hash ? a.hash < b.hash : memcmp(a.masks, b.masks, sizeof(a.masks)) < 0;
+    };
+    auto same = [](const PackedBoard& a, const PackedBoard& b)
+    {
+        return a.hash == b.hash && memcmp(a.masks, b.masks, sizeof(a.masks)) == 0;
+    };
+    BoardPackHeader header = { MAGIC, sizeof(PackedBoard), {}, {} };
+    PackedBoard* levels[4];
+    Board board(1, seed, itemDensity);
+    uint64_t total = 0;
+    for (int level = 1; level <= 4; ++level)
+    {
+        long long capacity = 4 * perLevel;
+        PackedBoard* boards = new PackedBoard[max(1LL, capacity)];
+        long long count = 0;
+        for (long long attempt = 0; attempt < capacity && count < perLevel;)
+        {
+            long long batch = min(perLevel - count, capacity - attempt);
+            for (long long b = 0; b < batch; ++b, ++attempt)
+            {
+                board.reset(level, Rng::mix(seed, static_cast<uint64_t>(level) << 40 | static_cast<uint64_t>(attempt)));
+                boards[count + b] = pack(board);
+            }
+            sort(boards, boards + count + batch, before);
+            count = unique(boards, boards + count + batch, same) - boards;
+        }
+        levels[level - 1] = boards;
+        header.first[level - 1] = total;
+        header.count[level - 1] = static_cast<uint64_t>(count);
+        uniqueCounts[level - 1] = count;
+        total += count;
+    }
+
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (int level = 1; level <= 4; ++level)
+    {
+        out.write(reinterpret_cast<const char*>(levels[level - 1]), header.count[level - 1] * sizeof(PackedBoard));
+        delete[] levels[level - 1];
+    }
+    out.close();
+    if (!out)
+    {
+        error = "Cannot write " + path;
+        return false;
+    }
+    return true;
+}
+bool BoardPack::open(const string& path, string& error)
+{
+    close();
+    error_code code;
+    uintmax_t size = filesystem::file_size(path, code);
+    if (code || size < sizeof(BoardPackHeader))
+    {
+        error = "Cannot open board pack " + path;
+        return false;
+    }
+#ifdef AQ_SHARED_MEMORY
+    int fd = ::open(path.c_str(), O_RDONLY);
+    void* view = fd < 0 ? MAP_FAILED : mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    if (view == MAP_FAILED)
+    {
+        error = "Cannot map board pack " + path + ": " + strerror(errno);
+        return false;
+    }
+    mapping = static_cast<const char*>(view);
+    mapped = true;
+#else
+    char* buffer = new char[size];
+    ifstream in(path, ios::binary);
+    if (!in.read(buffer, size))
+    {
+        delete[] buffer;
+        error = "Cannot read board pack " + path;
+        return false;
+    }
+    mapping = buffer;
+#endif
+    mappedSize = size;
+    const BoardPackHeader* candidate = reinterpret_cast<const BoardPackHeader*>(mapping);
+    uint64_t records = size >= sizeof(BoardPackHeader) ? (size - sizeof(BoardPackHeader)) / sizeof(PackedBoard) : 0;
+    bool valid = candidate->magic == MAGIC && candidate->recordSize == sizeof(PackedBoard);
+    for (int level = 0; level < 4 && valid; ++level)
+    {
+        valid = candidate->first[level] <= records && candidate->count[level] <= records - candidate->first[level];
+    }
+    if (!valid)
+    {
+        error = path + " is not a board pack written by this version of the game";
+        close();
+        return false;
+    }
+    header = candidate;
+    this->records = reinterpret_cast<const PackedBoard*>(mapping + sizeof(BoardPackHeader));
+    return true;
+}
+void BoardPack::close()
+{
+    if (!mapping)
+    {
+        return;
+    }
+#ifdef AQ_SHARED_MEMORY
+    munmap(const_cast<char*>(mapping), mappedSize);
+#else
+    delete[] mapping;
+#endif
+    mapping = nullptr;
+    mappedSize = 0;
+    header = nullptr;
+    records = nullptr;
+}
+void BoardPack::load(int level, long long index, Board& board) const
+{
+    const PackedBoard& packed = record(level, index);
+    BitBoard masks[Board::BOARD_KINDS];
+    for (int slot = 0; slot < Board::BOARD_KINDS; ++slot)
+    {
+        masks[slot] = BitBoard(packed.masks[slot][0], packed.masks[slot][1]);
+    }
+    board.load(level, packed.seed, masks);
+}
+int runPackBoards(int argc, char* argv[])
+{
+    bool valid = true;
+    long long perLevel = readNumber<long long>(argc, argv, "--boards", "100000", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    string path = readOption(argc, argv, "--out", "boards.aqpack");
+    if (!valid)
+    {
+        return 1;
+    }
+    if (perLevel < 1)
+    {
+        cout << "Invalid pack options!" << endl;
+        return 1;
+    }
+    long long unique[4];
+    string error;
+    auto started = chrono::steady_clock::now();
+    if (!BoardPack::generate(path, perLevel, seed, DEFAULT_RULES.itemDensity, unique, error))
+    {
+        cout << error << "!" << endl;
+        return 1;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cout << "Packed " << unique[0] << ", " << unique[1] << ", " << unique[2] << ", " << unique[3] << " unique boards for levels 1-4 -> " << path << " in " << fixed << setprecision(2) << seconds << " s" << endl;
+    return 0;
+}
+int runRecord(int argc, char* argv[])
+{
+    bool valid = true;
+    long long games = readNumber<long long>(argc, argv, "--games", "1000", valid);
+    int level = readNumber<int>(argc, argv, "--level", "0", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    int maxRounds = readNumber<int>(argc, argv, "--max-rounds", "1000", valid);
+    int playerCount = readNumber<int>(argc, argv, "--players", "2", valid);
+    int interval = readNumber<int>(argc, argv, "--interval", "32", valid);
+    int budget = readNumber<int>(argc, argv, "--budget", "0", valid);
+    int depth = readNumber<int>(argc, argv, "--depth", "4", valid);
+    string prefix = readOption(argc, argv, "--out", "replays");
+    string botList = readOption(argc, argv, "--bot", "random");
+    if (!valid)
+    {
+        return 1;
+    }
+    string botNames[AdventureQuest::MAX_PLAYERS];
+    int botCount = 0;
+    for (size_t start = 0; start <= botList.size() && botCount < AdventureQuest::MAX_PLAYERS; ++botCount)
+    {
+        size_t comma = min(botList.find(',', start), botList.size());
+        botNames[botCount] = botList.substr(start, comma - start);
+        start = comma + 1;
+        Bot* probe = makeBot(botNames[botCount], 0, budget, depth);
+        if (!probe)
+        {
+            cout << "Unknown bot " << botNames[botCount] << "!" << endl;
+            return 1;
+        }
+        delete probe;
+    }
+
+    ReplayWriter writer;
+    string error;
+    if (!writer.open(prefix, interval, error))
+    {
+        cout << error << "!" << endl;
+        return 1;
+    }
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    long long turns = 0;
+    for (long long i = 0; i < games; ++i)
+    {
+        uint64_t gameSeed = Rng::mix(seed, static_cast<uint64_t>(i));
+        int gameLevel = level >= 1 && level <= 4 ? level : 1 + static_cast<int>(i % 4);
+        AdventureQuest game(gameLevel, gameSeed, playerCount);
+        Bot* pool[AdventureQuest::MAX_PLAYERS];
+        Bot* bots[AdventureQuest::MAX_PLAYERS];
+        for (int b = 0; b < botCount; ++b)
+        {
+            pool[b] = makeBot(botNames[b], Rng::mix(gameSeed, 1 + b), budget, depth);
+        }
+        for (int seat = 0; seat < game.getPlayerCount(); ++seat)
+        {
+            bots[seat] = pool[seat % botCount];
+        }
+        turns += writer.addGame(static_cast<uint64_t>(i), game, bots, maxRounds);
+        for (int b = 0; b < botCount; ++b)
+        {
+            delete pool[b];
+        }
+    }
+    GameLog::setQuiet(wasQuiet);
+    if (!writer.close(error))
+    {
+        cout << error << "!" << endl;
+        return 1;
+    }
+    cout << "Recorded " << writer.getGameCount() << " games, " << turns << " turns, " << writer.getBytes() << " bytes -> " << prefix << ".aqr, " << prefix << ".aqi" << endl;
+    return 0;
+}
+int runReplay(int argc, char* argv[])
+{
+    string prefix = argc > 2 && string(argv[2]).compare(0, 2, "--") != 0 ? argv[2] : "replays";
+    bool valid = true;
+    long long checks = readNumber<long long>(argc, argv, "--check", "0", valid);
+    uint64_t checkSeed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    uint64_t id = readNumber<uint64_t>(argc, argv, "--game", "0", valid);
+    int turn = readNumber<int>(argc, argv, "--turn", "0", valid);
+    if (!valid)
+    {
+        return 1;
+    }
+    ReplayReader reader;
+    string error;
+    if (!reader.open(prefix, error))
+    {
+        cout << error << "!" << endl;
+        return 1;
+    }
+    AdventureQuest game(1, 0, 2);
+    if (checks > 0)
+    {
+        if (reader.getGameCount() == 0)
+        {
+            cout << "No games in " << prefix << "!" << endl;
+            return 1;
+        }
+        Rng rng(checkSeed);
+        AdventureQuest full(1, 0, 2);
+        string expected;
+        string actual;
+        long long mismatches = 0;
+        double seconds = 0.0;
+        for (long long c = 0; c < checks; ++c)
+        {
+            uint64_t id = reader.getGameId(rng.nextInt(static_cast<int>(min<long long>(reader.getGameCount(), INT32_MAX))));
+            ReplayHeader header;
+            uint64_t recordOffset;
+            if (!reader.readHeader(id, header, recordOffset))
+            {
+                mismatches++;
+                continue;
+            }
+            int turn = rng.nextInt(header.turns + 1);
+            auto started = chrono::steady_clock::now();
+            bool seeked = reader.seek(id, turn, game, error);
+            seconds += chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            expected.clear();
+            actual.clear();
+            if (seeked && reader.seek(id, turn, full, error, true))
+            {
+                full.writeState(expected);
+                game.writeState(actual);
+            }
+            if (!seeked || expected != actual || expected.empty())
+            {
+                mismatches++;
+            }
+        }
+        cout << "Checked " << checks << " seeks against full replays: " << mismatches << " mismatches, " << fixed << setprecision(1) << seconds * 1e6 / checks << " us per seek" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    if (!reader.seek(id, turn, game, error))
+    {
+        cout << error << "!" << endl;
+        return 1;
+    }
+    cout << "Game " << id << ", level " << game.getBoardLevel() << ", round " << game.getRound() << ", before turn " << turn << endl;
+    game.getBoard().print(&game.getPlayer(0), game.getPlayerCount());
+    for (int seat = 0; seat < game.getPlayerCount(); ++seat)
+    {
+        cout << "P" << seat + 1 << ": ";
+        game.getPlayer(seat).printStatus();
+    }
+    return 0;
+}
+int* RuleSet::field(const string& key)
+{
+    static const char* const HURDLE_KEYS[HURDLE_KINDS] = { "fire", "snake", "ghost", "lion", "lock" };
+    static const char* const HELPER_KEYS[HELPER_KINDS] = { "sword", "shield", "water", "key" };
+    if (key == "start_gold")
+    {
+        return &startGold;
+    }
+    if (key == "start_silver")
+    {
+        return &startSilver;
+    }
+    if (key == "item_density")
+    {
+        return &itemDensity;
+    }
+    size_t dot = key.find('.');
+    if (dot == string::npos)
+    {
+        return nullptr;
+    }
+    string item = key.substr(0, dot);
+    string attribute = key.substr(dot + 1);
+    for (int h = 0; h < HURDLE_KINDS; ++h)
+    {
+        if (item != HURDLE_KEYS[h])
+        {
+            continue;
+        }
+        HurdleRule& rule = hurdles[h];
+        if (attribute == "cost")
+        {
+            return &rule.cost;
+        }
+        if (attribute == "gold_cost")
+        {
+            return &rule.goldCost;
+        }
+        if (attribute == "silver_cost")
+        {
+            return &rule.silverCost;
+        }
+        if (attribute == "penalty")
+        {
+            return &rule.penalty;
+        }
+        if (attribute == "block_turns")
+        {
+            return &rule.blockTurns;
+        }
+        if (attribute == "push_back")
+        {
+            return &rule.pushBack;
+        }
+        return nullptr;
+    }
+    for (int k = 0; k < HELPER_KINDS; ++k)
+    {
+        if (item != HELPER_KEYS[k])
+        {
+            continue;
+        }
+        HelperRule& rule = helpers[k];
+        if (attribute == "cost")
+        {
+            return &rule.cost;
+        }
+        if (attribute == "silver_cost")
+        {
+            return &rule.silverCost;
+        }
+        if (attribute == "uses")
+        {
+            return &rule.uses;
+        }
+        return nullptr;
+    }
+    return nullptr;
+}
+void SweepTally::merge(const SweepTally& other)
+{
+    games += other.games;
+    seats = max(seats, other.seats);
+    for (int s = 0; s < MAX_SEATS; ++s)
+    {
+        wins[s] += other.wins[s];
+        points[s] += other.points[s];
+    }
+    draws += other.draws;
+    timeouts += other.timeouts;
+    finished += other.finished;
+    rounds += other.rounds;
+    hurdles += other.hurdles;
+    helpers += other.helpers;
+}
+void SweepObserver::onGameEnd(const AdventureQuest& game, int winner, bool finished)
+{
+    tally->games++;
+    tally->seats = max(tally->seats, static_cast<long long>(game.getPlayerCount()));
+    if (winner >= 0)
+    {
+        tally->wins[winner]++;
+    }
+    else if (finished)
+    {
+        tally->draws++;
+    }
+    else
+    {
+        tally->timeouts++;
+    }
+    tally->finished += finished ? 1 : 0;
+    tally->rounds += game.getRound();
+    for (int seat = 0; seat < game.getPlayerCount(); ++seat)
+    {
+        tally->points[seat] += game.getPlayer(seat).getPoints();
+    }
+}
+bool RuleSweep::load(const string& path, string& error)
+{
+    ifstream in(path);
+    if (!in)
+    {
+        error = "Cannot open " + path;
+        return false;
+    }
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line))
+    {
+        lineNumber++;
+        size_t hash = line.find('#');
+        if (hash != string::npos)
+        {
+            line = line.substr(0, hash);
+        }
+        string text;
+        for (char c : line)
+        {
+            if (c != ' ' && c != '\t' && c != '\r')
+            {
+                text += c;
+            }
+        }
+        if (text.empty())
+        {
+            continue;
+        }
+        size_t equals = text.find('=');
+        RuleSet probe = DEFAULT_RULES;
+        if (equals == string::npos || !probe.field(text.substr(0, equals)))
+        {
+            error = "Line " + to_string(lineNumber) + ": expected <rule> = <values> with a known rule name";
+            return false;
+        }
+        if (keyCount == MAX_KEYS)
+        {
+            error = "Too many swept rules";
+            return false;
+        }
+        keys[keyCount] = text.substr(0, equals);
+        valueCount[keyCount] = 0;
+        string list = text.substr(equals + 1);
+        try
+        {
+            size_t start = 0;
+            while (start <= list.size())
+            {
+                size_t comma = list.find(',', start);
+                string item = list.substr(start, comma == string::npos ? string::npos : comma - start);
+                size_t range = item.find("..");
+                int low = stoi(item.substr(0, range));
+                int high = low;
+                int step = 1;
+                if (range != string::npos)
+                {
+                    string rest = item.substr(range + 2);
+                    size_t colon = rest.find(':');
+                    high = stoi(rest.substr(0, colon));
+                    if (colon != string::npos)
+                    {
+                        step = stoi(rest.substr(colon + 1));
+                    }
+                }
+                if (low < 0 || high < low || step < 1)
+                {
+                    throw invalid_argument(item);
+                }
+                for (int v = low; v <= high; v += step)
+                {
+                    if (valueCount[keyCount] == MAX_VALUES)
+                    {
+                        throw out_of_range(item);
+                    }
+                    values[keyCount][valueCount[keyCount]++] = v;
+                }
+                if (comma == string::npos)
+                {
+                    break;
+                }
+                start = comma + 1;
+            }
+        }
+        catch (const exception&)
+        {
+            error = "Line " + to_string(lineNumber) + ": values must be non-negative integers, lists a,b,c or ranges lo..hi[:step], at most " + to_string(MAX_VALUES) + " per rule";
+            return false;
+        }
+        keyCount++;
+    }
+    return true;
+}
+long long RuleSweep::gridSize() const
+{
+    long long size = 1;
+    for (int k = 0; k < keyCount && size > 0; ++k)
+    {
+        size = size > (1LL << 40) / valueCount[k] ? -1 : size * valueCount[k];
+    }
+    return size;
+}
+void RuleSweep::enumerate()
+{
+    configCount = static_cast<int>(gridSize());
+    delete[] choices;
+    choices = new int[static_cast<long long>(configCount) * keyCount + 1];
+    for (int c = 0; c < configCount; ++c)
+    {
+        int index = c;
+        for (int k = keyCount - 1; k >= 0; --k)
+        {
+            choices[c * keyCount + k] = index % valueCount[k];
+            index /= valueCount[k];
+        }
+    }
+}
+void RuleSweep::sample(int count, uint64_t seed)
+{
+    configCount = count;
+    delete[] choices;
+    choices = new int[static_cast<long long>(configCount) * keyCount + 1];
+    Rng rng(Rng::mix(seed, 0x5EEDULL));
+    for (int c = 0; c < configCount; ++c)
+    {
+        for (int k = 0; k < keyCount; ++k)
+        {
+            choices[c * keyCount + k] = rng.nextInt(valueCount[k]);
+        }
+    }
+}
+void RuleSweep::apply(int config, RuleSet& rules) const
+{
+    for (int k = 0; k < keyCount; ++k)
+    {
+        *rules.field(keys[k]) = values[k][choices[config * keyCount + k]];
+    }
+}
+bool RuleSweep::writeResults(const string& path, const SweepTally* tallies) const
+{
+    ofstream out(path);
+    if (!out)
+    {
+        return false;
+    }
+    out << "config";
+    for (int k = 0; k < keyCount; ++k)
+    {
+        out << "," << keys[k];
+    }
+    long long seats = 0;
+    for (int c = 0; c < configCount; ++c)
+    {
+        seats = max(seats, tallies[c].seats);
+    }
+    out << ",games";
+    for (int s = 0; s < seats; ++s)
+    {
+        out << ",p" << s + 1 << "_win_rate";
+    }
+    out << ",draw_rate,timeout_rate,finish_rate,mean_rounds";
+    for (int s = 0; s < seats; ++s)
+    {
+        out << ",p" << s + 1 << "_mean_points";
+    }
+    out << ",hurdles_per_game,helpers_per_game" << endl;
+    for (int c = 0; c < configCount; ++c)
+    {
+        const SweepTally& t = tallies[c];
+        double games = static_cast<double>(max(t.games, 1LL));
+        out << c;
+        for (int k = 0; k < keyCount; ++k)
+        {
+            out << "," << values[k][choices[c * keyCount + k]];
+        }
+        out << "," << t.games;
+        for (int s = 0; s < seats; ++s)
+        {
+            out << "," << t.wins[s] / games;
+        }
+        out << "," << t.draws / games << "," << t.timeouts / games << "," << t.finished / games << "," << t.rounds / games;
+        for (int s = 0; s < seats; ++s)
+        {
+            out << "," << t.points[s] / games;
+        }
+        out << "," << t.hurdles / games << "," << t.helpers / games << endl;
+    }
+    return true;
+}
+uint64_t SweepCheckpoint::checksum(const int64_t* words, int count)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < count; ++i)
+    {
+        hash = (hash ^ static_cast<uint64_t>(words[i])) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+bool SweepCheckpoint::open(const string& path, uint64_t configHash, long long units, SweepTally* tallies, atomic<uint8_t>* done, long long& restored, string& error)
+{
+    int64_t header[HEADER_WORDS] = { static_cast<int64_t>(MAGIC), static_cast<int64_t>(configHash), units, 0 };
+    header[HEADER_WORDS - 1] = static_cast<int64_t>(checksum(header, HEADER_WORDS - 1));
+    restored = 0;
+    long long validBytes = 0;
+    ifstream in(path, ios::binary);
+    if (in)
+    {
+        int64_t saved[HEADER_WORDS];
+        if (!in.read(reinterpret_cast<char*>(saved), sizeof(saved)) || memcmp(saved, header, sizeof(header)) != 0)
+        {
+            error = path + " is a checkpoint for a different sweep; remove it or pass another --checkpoint";
+            return false;
+        }
+        validBytes = sizeof(header);
+        int64_t record[RECORD_WORDS];
+        while (in.read(reinterpret_cast<char*>(record), sizeof(record)))
+        {
+            long long unit = record[0];
+            if (static_cast<uint64_t>(record[RECORD_WORDS - 1]) != checksum(record, RECORD_WORDS - 1) || unit < 0 || unit >= units)
+            {
+                break;
+            }
+            memcpy(&tallies[unit], &record[1], sizeof(SweepTally));
+            if (done[unit].exchange(2) == 0)
+            {
+                restored++;
+            }
+            validBytes += sizeof(record);
+        }
+        in.close();
+        error_code ec;
+        filesystem::resize_file(path, validBytes, ec);
+        if (ec)
+        {
+            error = "Cannot truncate " + path + ": " + ec.message();
+            return false;
+        }
+    }
+
+    file.open(path, ios::binary | ios::app);
+    if (!file)
+    {
+        error = "Cannot open " + path + " for writing";
+        return false;
+    }
+    if (validBytes == 0)
+    {
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+    return flush();
+}
+void SweepCheckpoint::append(long long unit, const SweepTally& tally)
+{
+    int64_t record[RECORD_WORDS];
+    record[0] = unit;
+    memcpy(&record[1], &tally, sizeof(SweepTally));
+    record[RECORD_WORDS - 1] = static_cast<int64_t>(checksum(record, RECORD_WORDS - 1));
+    file.write(reinterpret_cast<const char*>(record), sizeof(record));
+}
+bool SweepCheckpoint::flush()
+{
+    file.flush();
+    return static_cast<bool>(file);
+}
+int runSweep(int argc, char* argv[])
+{
+    string file = argc > 2 ? argv[2] : "";
+    bool valid = true;
+    long long games = readNumber<long long>(argc, argv, "--games", "1000", valid);
+    int level = readNumber<int>(argc, argv, "--level", "0", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    int maxRounds = readNumber<int>(argc, argv, "--max-rounds", "1000", valid);
+    int playerCount = readNumber<int>(argc, argv, "--players", "2", valid);
+    int samples = readNumber<int>(argc, argv, "--samples", "0", valid);
+    int threads = readNumber<int>(argc, argv, "--threads", to_string(max(1u, thread::hardware_concurrency())), valid);
+    string out = readOption(argc, argv, "--out", "sweep.csv");
+    string checkpointPath = readOption(argc, argv, "--checkpoint", "");
+    int checkpointSeconds = readNumber<int>(argc, argv, "--checkpoint-every", "10", valid);
+    if (!valid)
+    {
+        return 1;
+    }
+
+    RuleSweep sweep;
+    string error;
+    if (!sweep.load(file, error))
+    {
+        cout << error << endl;
+        return 1;
+    }
+    if (samples > 0)
+    {
+        sweep.sample(samples, seed);
+    }
+    else if (sweep.gridSize() < 0 || sweep.gridSize() > 1000000)
+    {
+        cout << "Grid has too many configurations; use --samples N" << endl;
+        return 1;
+    }
+    else
+    {
+        sweep.enumerate();
+    }
+    if (games < 1 || threads < 1 || checkpointSeconds < 1)
+    {
+        cout << "Invalid sweep options!" << endl;
+        return 1;
+    }
+
+    const long long BLOCK = 256;
+    long long blocksPerConfig = (games + BLOCK - 1) / BLOCK;
+    long long units = sweep.getConfigCount() * blocksPerConfig;
+    SweepTally* tallies = new SweepTally[units]();
+    atomic<uint8_t>* done = new atomic<uint8_t>[units];
+    for (long long unit = 0; unit < units; ++unit)
+    {
+        done[unit].store(0, memory_order_relaxed);
+    }
+
+    SweepCheckpoint checkpoint;
+    if (!checkpointPath.empty())
+    {
+        ifstream rulesFile(file, ios::binary);
+        string rulesText((istreambuf_iterator<char>(rulesFile)), istreambuf_iterator<char>());
+        int64_t options[6] = { games, level, static_cast<int64_t>(seed), maxRounds, playerCount, samples };
+        uint64_t configHash = SweepCheckpoint::checksum(options, 6);
+        for (char c : rulesText)
+        {
+            configHash = (configHash ^ static_cast<uint8_t>(c)) * 0x100000001B3ULL;
+        }
+        long long restored = 0;
+        if (!checkpoint.open(checkpointPath, configHash, units, tallies, done, restored, error))
+        {
+            cout << error << endl;
+            delete[] tallies;
+            delete[] done;
+            return 1;
+        }
+        if (restored > 0)
+        {
+            cout << "Resuming: " << restored << " of " << units << " blocks restored from " << checkpointPath << endl;
+        }
+    }
+
+    mutex writerMutex;
+    condition_variable writerWake;
+    bool workersDone = false;
+    bool checkpointFailed = false;
+    auto writer = [&]()
+    {
+        unique_lock<mutex> lock(writerMutex);
+        while (true)
+        {
+            bool last = writerWake.wait_for(lock, chrono::seconds(checkpointSeconds), [&]() { return workersDone; });
+            for (long long unit = 0; unit < units; ++unit)
+            {
+                if (done[unit].load(memory_order_acquire) == 1)
+                {
+                    checkpoint.append(unit, tallies[unit]);
+                    done[unit].store(2, memory_order_relaxed);
+                }
+            }
+            checkpointFailed = checkpointFailed || !checkpoint.flush();
+            if (last)
+            {
+                break;
+            }
+        }
+    };
+    thread checkpointWriter;
+    if (!checkpointPath.empty())
+    {
+        checkpointWriter = thread(writer);
+    }
+
+    atomic<long long> nextUnit(0);
+    auto worker = [&]()
+    {
+        for (long long unit = nextUnit++; unit < units; unit = nextUnit++)
+        {
+            if (done[unit].load(memory_order_relaxed) != 0)
+            {
+                continue;
+            }
+            int config = static_cast<int>(unit / blocksPerConfig);
+            long long first = unit % blocksPerConfig * BLOCK;
+            RuleSet rules = DEFAULT_RULES;
+            sweep.apply(config, rules);
+            SweepObserver observer(&tallies[unit]);
+            for (long long i = first; i < min(games, first + BLOCK); ++i)
+            {
+                uint64_t gameSeed = Rng::mix(seed, static_cast<uint64_t>(i));
+                int gameLevel = level >= 1 && level <= 4 ? level : 1 + static_cast<int>(i % 4);
+                AdventureQuest game(gameLevel, gameSeed, playerCount, &rules);
+                game.setObserver(&observer);
+                RandomBot bot(Rng::mix(gameSeed, 1));
+                game.runSimulation(bot, maxRounds);
+            }
+            done[unit].store(1, memory_order_release);
+        }
+    };
+    thread* pool = new thread[threads];
+    for (int t = 0; t < threads; ++t)
+    {
+        pool[t] = thread(worker);
+    }
+    for (int t = 0; t < threads; ++t)
+    {
+        pool[t].join();
+    }
+    delete[] pool;
+    if (checkpointWriter.joinable())
+    {
+        {
+            lock_guard<mutex> lock(writerMutex);
+            workersDone = true;
+        }
+        writerWake.notify_one();
+        checkpointWriter.join();
+    }
+    delete[] done;
+    if (checkpointFailed)
+    {
+        cout << "Cannot write " << checkpointPath << "!" << endl;
+    }
+
+    SweepTally* results = new SweepTally[sweep.getConfigCount()]();
+    for (long long unit = 0; unit < units; ++unit)
+    {
+        results[unit / blocksPerConfig].merge(tallies[unit]);
+    }
+    bool written = sweep.writeResults(out, results);
+    delete[] tallies;
+    delete[] results;
+    if (!written)
+    {
+        cout << "Cannot write " << out << "!" << endl;
+        return 1;
+    }
+    cout << "Simulated " << sweep.getConfigCount() << " configurations x " << games << " games on " << threads << " threads -> " << out << endl;
+    return 0;
+}
+TurnAction MoveBot::chooseAction(const AdventureQuest& /*game*/, int /*seat*/)
+{
+    TurnAction action = { ACTION_MOVE, 0, 0 };
+    return action;
+}
+int PolicyBot::pickWeighted(const int* weights, const bool* allowed, int count)
+{
+    int total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        total += allowed[i] ? weights[i] : 0;
+    }
+    if (total == 0)
+    {
+        return -1;
+    }
+    int roll = rng.nextInt(total);
+    for (int i = 0; i < count; ++i)
+    {
+        roll -= allowed[i] ? weights[i] : 0;
+        if (roll < 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+TurnAction PolicyBot::chooseHurdle(const AdventureQuest& game, int seat)
+{
+    TurnAction action = { ACTION_NONE, 0, 0 };
+    const Player& self = game.getPlayer(seat);
+    int target = game.closestOpponent(seat);
+    if (target < 0)
+    {
+        return action;
+    }
+
+    const Player& opponent = game.getPlayer(target);
+    int lo = policy.genes[GENE_AHEAD_MIN];
+    int hi = max(lo, policy.genes[GENE_AHEAD_MAX]);
+    int cell = opponent.getCurrentNumber() + opponent.getDirection() * (lo + rng.nextInt(hi - lo + 1));
+    int totalCells = game.getBoard().getSize() * game.getBoard().getSize();
+    if (cell < 1 || cell > totalCells || cell == game.getGoalNumber() || !game.getBoard().isEmpty(cell))
+    {
+        return action;
+    }
+
+    bool affordable[HURDLE_KINDS];
+    for (int h = 0; h < HURDLE_KINDS; ++h)
+    {
+        const HurdleRule& rule = game.getRules().hurdles[h];
+        affordable[h] = self.getPoints() - rule.cost >= policy.genes[GENE_HURDLE_RESERVE] && self.getGold() >= rule.goldCost && self.getSilver() >= rule.silverCost;
+    }
+    int choice = pickWeighted(&policy.genes[GENE_HURDLE_WEIGHT], affordable, HURDLE_KINDS);
+    if (choice >= 0)
+    {
+        action = { ACTION_PLACE_HURDLE, choice + 1, cell };
+    }
+    return action;
+}
+TurnAction PolicyBot::chooseHelper(const AdventureQuest& game, int seat)
+{
+    TurnAction action = { ACTION_NONE, 0, 0 };
+    const Player& self = game.getPlayer(seat);
+    if (self.getInventorySize() >= policy.genes[GENE_MAX_HELPERS])
+    {
+        return action;
+    }
+
+    bool affordable[HELPER_KINDS];
+    for (int k = 0; k < HELPER_KINDS; ++k)
+    {
+        const HelperRule& rule = game.getRules().helpers[k];
+        affordable[k] = self.getPoints() - rule.cost >= policy.genes[GENE_HELPER_RESERVE] && self.getSilver() >= rule.silverCost;
+    }
+    for (int step = 1; step <= policy.genes[GENE_LOOKAHEAD]; ++step)
+    {
+        ItemKind kind = game.getBoard().getKind(self.getCurrentNumber() + self.getDirection() * step);
+        if (!isHurdleKind(kind))
+        {
+            continue;
+        }
+        ItemKind neutralizer = game.getRules().hurdle(kind).neutralizer;
+        if (!self.hasHelper(neutralizer) && affordable[neutralizer - KIND_SWORD])
+        {
+            action = { ACTION_BUY_HELPER, neutralizer - KIND_SWORD + 1, 0 };
+        }
+        return action;
+    }
+
+    if (rng.nextInt(100) < policy.genes[GENE_HELPER_RATE])
+    {
+        int choice = pickWeighted(&policy.genes[GENE_HELPER_WEIGHT], affordable, HELPER_KINDS);
+        if (choice >= 0)
+        {
+            action = { ACTION_BUY_HELPER, choice + 1, 0 };
+        }
+    }
+    return action;
+}
+TurnAction PolicyBot::chooseAction(const AdventureQuest& game, int seat)
+{
+    TurnAction action = { ACTION_NONE, 0, 0 };
+    if (rng.nextInt(100) < policy.genes[GENE_HURDLE_RATE])
+    {
+        action = chooseHurdle(game, seat);
+    }
+    if (action.type == ACTION_NONE)
+    {
+        action = chooseHelper(game, seat);
+    }
+    if (action.type == ACTION_NONE)
+    {
+        action = { ACTION_MOVE, 0, 0 };
+    }
+    return action;
+}
+int SearchBot::candidateActions(const AdventureQuest& game, int seat, TurnAction* actions) const
+{
+    const Player& self = game.getPlayer(seat);
+    int count = 0;
+    if (self.isBlocked())
+    {
+        actions[count++] = { ACTION_MOVE, 0, 0 };
+        return count;
+    }
+
+    int target = game.closestOpponent(seat);
+    if (target >= 0)
+    {
+        const Player& opponent = game.getPlayer(target);
+        int totalCells = game.getBoard().getSize() * game.getBoard().getSize();
+        for (int ahead = 1; ahead <= 3; ++ahead)
+        {
+            int cell = opponent.getCurrentNumber() + opponent.getDirection() * ahead;
+            if (cell < 1 || cell > totalCells || cell == game.getGoalNumber() || !game.getBoard().isEmpty(cell))
+            {
+                continue;
+            }
+            for (int h = 0; h < HURDLE_KINDS; ++h)
+            {
+                const HurdleRule& rule = game.getRules().hurdles[h];
+                if (self.getPoints() >= rule.cost && self.getGold() >= rule.goldCost && self.getSilver() >= rule.silverCost)
+                {
+                    actions[count++] = { ACTION_PLACE_HURDLE, h + 1, cell };
+                }
+            }
+        }
+    }
+    actions[count++] = { ACTION_MOVE, 0, 0 };
+
+    for (int k = 0; k < HELPER_KINDS; ++k)
+    {
+        const HelperRule& rule = game.getRules().helpers[k];
+        if (!self.hasHelper(static_cast<ItemKind>(KIND_SWORD + k)) && self.getInventorySize() < self.getInventoryCapacity() && self.getPoints() >= rule.cost && self.getSilver() >= rule.silverCost)
+        {
+            actions[count++] = { ACTION_BUY_HELPER, k + 1, 0 };
+        }
+    }
+    return count;
+}
+int SearchBot::nextSeat(const AdventureQuest& game, int seat)
+{
+    for (int step = 1; step <= game.getPlayerCount(); ++step)
+    {
+        int next = (seat + step) % game.getPlayerCount();
+        if (!game.getPlayer(next).hasReachedGoalState())
+        {
+            return next;
+        }
+    }
+    return -1;
+}
+int SearchBot::playerValue(const AdventureQuest& game, int seat)
+{
+    const Player& player = game.getPlayer(seat);
+    int value = player.getPoints() + game.coinValueAhead(seat) - game.hurdleCostAhead(seat);
+    value -= DISTANCE_WEIGHT * abs(game.getGoalNumber() - player.getCurrentNumber()) + BLOCK_WEIGHT * min(game.getBlockedTurns(seat), 10);
+    for (int i = 0; i < player.getInventorySize(); ++i)
+    {
+        value += HELPER_WEIGHT * player.getInventoryItem(i)->getUses();
+    }
+    return player.hasReachedGoalState() ? value + GOAL_BONUS : value;
+}
+int SearchBot::evaluate(const AdventureQuest& game) const
+{
+    if (game.isFinished())
+    {
+        int winner = game.getWinner();
+        return winner == rootSeat ? WIN_SCORE : winner < 0 ? 0 : -WIN_SCORE;
+    }
+    int best = INT32_MIN;
+    for (int q = 0; q < game.getPlayerCount(); ++q)
+    {
+        if (q != rootSeat)
+        {
+            best = max(best, playerValue(game, q));
+        }
+    }
+    return playerValue(game, rootSeat) - best;
+}
+int SearchBot::search(const AdventureQuest& game, int seat, int depth, int alpha, int beta)
+{
+    nodes++;
+    if (budgetMs > 0 && chrono::steady_clock::now() >= deadline)
+    {
+        timedOut = true;
+    }
+    if (timedOut || depth == 0 || seat < 0)
+    {
+        return evaluate(game);
+    }
+
+    TurnAction actions[MAX_ACTIONS];
+    int count = candidateActions(game, seat, actions);
+    bool maximizing = seat == rootSeat;
+    int best = maximizing ? INT32_MIN : INT32_MAX;
+    for (int i = 0; i < count && !timedOut; ++i)
+    {
+        AdventureQuest child(game);
+        child.stepTurn(seat, actions[i]);
+        int score = search(child, nextSeat(child, seat), depth - 1, alpha, beta);
+        if (maximizing)
+        {
+            best = max(best, score);
+            alpha = max(alpha, score);
+        }
+        else
+        {
+            best = min(best, score);
+            beta = min(beta, score);
+        }
+        if (alpha >= beta)
+        {
+            break;
+        }
+    }
+    return best;
+}
+TurnAction SearchBot::chooseAction(const AdventureQuest& game, int seat)
+{
+    AQ_TRACE_SPAN("SearchBot::chooseAction");
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    rootSeat = seat;
+    timedOut = false;
+    nodes = 0;
+    lastDepth = 0;
+    deadline = chrono::steady_clock::now() + chrono::milliseconds(budgetMs);
+
+    TurnAction actions[MAX_ACTIONS];
+    int count = candidateActions(game, seat, actions);
+    TurnAction bestAction = { ACTION_MOVE, 0, 0 };
+    for (int depth = 1; depth <= maxDepth && count > 1 && !timedOut; ++depth)
+    {
+        AQ_TRACE_SPAN("SearchBot::deepen");
+        int alpha = INT32_MIN;
+        int bestIndex = -1;
+        for (int i = 0; i < count; ++i)
+        {
+            AdventureQuest child(game);
+            child.stepTurn(seat, actions[i]);
+            int score = search(child, nextSeat(child, seat), depth - 1, alpha, INT32_MAX);
+            if (timedOut)
+            {
+                break;
+            }
+            if (bestIndex < 0 || score > alpha)
+            {
+                alpha = score;
+                bestIndex = i;
+            }
+        }
+        if (bestIndex >= 0)
+        {
+            swap(actions[0], actions[bestIndex]);
+            bestAction = actions[0];
+        }
+        if (timedOut || bestIndex < 0)
+        {
+            break;
+        }
+        lastDepth = depth;
+        if (alpha >= WIN_SCORE || alpha <= -WIN_SCORE)
+        {
+            break;
+        }
+    }
+    GameLog::setQuiet(wasQuiet);
+    return bestAction;
+}
+StrategySearch::StrategySearch(int populationSize, uint64_t seed, long long games, int level, int maxRounds) : populationSize(populationSize), generation(0), seed(seed), games(games), level(level), maxRounds(maxRounds), rng(seed)
+{
+    population = new Policy[populationSize];
+    fitness = new double[populationSize]();
+    population[0] = EVOLVED_POLICY;
+    for (int i = 1; i < populationSize; ++i)
+    {
+        randomize(population[i]);
+    }
+}
+StrategySearch::~StrategySearch()
+{
+    delete[] population;
+    delete[] fitness;
+}
+void StrategySearch::randomize(Policy& policy)
+{
+    for (int g = 0; g < POLICY_GENES; ++g)
+    {
+        const PolicyGene& gene = POLICY_GENE_RANGES[g];
+        policy.genes[g] = gene.lo + rng.nextInt(gene.hi - gene.lo + 1);
+    }
+}
+const Policy& StrategySearch::tournament()
+{
+    int winner = rng.nextInt(populationSize);
+    for (int round = 1; round < 3; ++round)
+    {
+        int challenger = rng.nextInt(populationSize);
+        if (fitness[challenger] > fitness[winner])
+        {
+            winner = challenger;
+        }
+    }
+    return population[winner];
+}
+void StrategySearch::mutate(Policy& policy)
+{
+    for (int g = 0; g < POLICY_GENES; ++g)
+    {
+        if (rng.nextInt(POLICY_GENES) >= 2)
+        {
+            continue;
+        }
+        const PolicyGene& gene = POLICY_GENE_RANGES[g];
+        int step = max(1, (gene.hi - gene.lo) / 8);
+        policy.genes[g] = max(gene.lo, min(gene.hi, policy.genes[g] + rng.nextInt(2 * step + 1) - step));
+    }
+}
+void StrategySearch::evaluate(int threads)
+{
+    const long long BLOCK = 64;
+    long long blocksPerPolicy = (games + BLOCK - 1) / BLOCK;
+    long long units = populationSize * blocksPerPolicy;
+    long long* scores = new long long[units]();
+    atomic<long long> nextUnit(0);
+    auto worker = [&]()
+    {
+        for (long long unit = nextUnit++; unit < units; unit = nextUnit++)
+        {
+            int index = static_cast<int>(unit / blocksPerPolicy);
+            long long first = unit % blocksPerPolicy * BLOCK;
+            for (long long i = first; i < min(games, first + BLOCK); ++i)
+            {
+                uint64_t gameSeed = Rng::mix(seed, static_cast<uint64_t>(i));
+                int gameLevel = level >= 1 && level <= 4 ? level : 1 + static_cast<int>(i % 4);
+                int seat = static_cast<int>(i % 2);
+                AdventureQuest game(gameLevel, gameSeed);
+                PolicyBot policyBot(population[index], Rng::mix(gameSeed, 2));
+                RandomBot randomBot(Rng::mix(gameSeed, 1));
+                Bot* bots[2] = { &randomBot, &randomBot };
+                bots[seat] = &policyBot;
+                game.runSimulation(bots, maxRounds);
+                int winner = game.getWinner();
+                scores[unit] += winner == seat ? 2 : winner < 0 ? 1 : 0;
+            }
+        }
+    };
+    thread* pool = new thread[threads];
+    for (int t = 0; t < threads; ++t)
+    {
+        pool[t] = thread(worker);
+    }
+    for (int t = 0; t < threads; ++t)
+    {
+        pool[t].join();
+    }
+    delete[] pool;
+
+    for (int index = 0; index < populationSize; ++index)
+    {
+        long long total = 0;
+        for (long long block = 0; block < blocksPerPolicy; ++block)
+        {
+            total += scores[index * blocksPerPolicy + block];
+        }
+        fitness[index] = static_cast<double>(total) / (2.0 * games);
+    }
+    delete[] scores;
+}
+void StrategySearch::breed(int elites)
+{
+    int* order = new int[populationSize];
+    for (int i = 0; i < populationSize; ++i)
+    {
+        order[i] = i;
+    }
+    sort(order, order + populationSize, [this](int a, int b) { return fitness[a] > fitness[b] || (fitness[a] == fitness[b] && a < b); });
+
+    Policy* next = new Policy[populationSize];
+    for (int i = 0; i < populationSize; ++i)
+    {
+        if (i < elites)
+        {
+            next[i] = population[order[i]];
+            continue;
+        }
+        const Policy& mother = tournament();
+        const Policy& father = tournament();
+        for (int g = 0; g < POLICY_GENES; ++g)
+        {
+            next[i].genes[g] = rng.nextInt(2) ? mother.genes[g] : father.genes[g];
+        }
+        mutate(next[i]);
+    }
+    delete[] order;
+    delete[] population;
+    population = next;
+    for (int i = 0; i < populationSize; ++i)
+    {
+        fitness[i] = 0;
+    }
+    generation++;
+}
+int StrategySearch::best() const
+{
+    int index = 0;
+    for (int i = 1; i < populationSize; ++i)
+    {
+        if (fitness[i] > fitness[index])
+        {
+            index = i;
+        }
+    }
+    return index;
+}
+bool StrategySearch::saveCheckpoint(const string& path) const
+{
+    string temp = path + ".tmp";
+    {
+        ofstream out(temp);
+        if (!out)
+        {
+            return false;
+        }
+        out << "AQEVOLVE2 " << seed << " " << generation << " " << populationSize << " " << POLICY_GENES << " " << rng.getState() << " " << games << " " << level << " " << maxRounds << endl;
+        for (int i = 0; i < populationSize; ++i)
+        {
+            for (int g = 0; g < POLICY_GENES; ++g)
+            {
+                out << (g > 0 ? " " : "") << population[i].genes[g];
+            }
+            out << endl;
+        }
+        if (!out)
+        {
+            return false;
+        }
+    }
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
+bool StrategySearch::loadCheckpoint(const string& path, string& error)
+{
+    ifstream in(path);
+    if (!in)
+    {
+        error = "Cannot open " + path;
+        return false;
+    }
+    string magic;
+    uint64_t savedSeed, state;
+    long long savedGames;
+    int savedGeneration, savedSize, savedGenes, savedLevel, savedMaxRounds;
+    in >> magic >> savedSeed >> savedGeneration >> savedSize >> savedGenes >> state >> savedGames >> savedLevel >> savedMaxRounds;
+    if (!in || magic != "AQEVOLVE2" || savedSeed != seed || savedSize != populationSize || savedGenes != POLICY_GENES)
+    {
+        error = path + " is not a checkpoint for this seed and population size";
+        return false;
+    }
+    if (savedGames != games || savedLevel != level || savedMaxRounds != maxRounds)
+    {
+        error = path + " was written with --games " + to_string(savedGames) + " --level " + to_string(savedLevel) + " --max-rounds " + to_string(savedMaxRounds);
+        return false;
+    }
+    Policy* loaded = new Policy[populationSize];
+    for (int i = 0; i < populationSize; ++i)
+    {
+        for (int g = 0; g < POLICY_GENES; ++g)
+        {
+            in >> loaded[i].genes[g];
+        }
+    }
+    if (!in)
+    {
+        delete[] loaded;
+        error = path + " is truncated";
+        return false;
+    }
+    delete[] population;
+    population = loaded;
+    generation = savedGeneration;
+    rng.setState(state);
+    return true;
+}
+bool StrategySearch::exportPolicy(const string& path, const Policy& policy, double fitness)
+{
+    ofstream out(path);
+    if (!out)
+    {
+        return false;
+    }
+    out << "// Fitness " << fixed << setprecision(4) << fitness << " against RandomBot:";
+    for (int g = 0; g < POLICY_GENES; ++g)
+    {
+        out << " " << POLICY_GENE_RANGES[g].name << "=" << policy.genes[g];
+    }
+    out << endl;
+    out << "constexpr Policy EVOLVED_POLICY = { {";
+    for (int g = 0; g < POLICY_GENES; ++g)
+    {
+        out << (g > 0 ? ", " : " ") << policy.genes[g];
+    }
+    out << " } };" << endl;
+    return static_cast<bool>(out);
+}
+int runEvolve(int argc, char* argv[])
+{
+    bool valid = true;
+    int populationSize = readNumber<int>(argc, argv, "--population", "32", valid);
+    int generations = readNumber<int>(argc, argv, "--generations", "20", valid);
+    long long games = readNumber<long long>(argc, argv, "--games", "400", valid);
+    int elites = readNumber<int>(argc, argv, "--elites", "2", valid);
+    int level = readNumber<int>(argc, argv, "--level", "0", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    int maxRounds = readNumber<int>(argc, argv, "--max-rounds", "1000", valid);
+    int threads = readNumber<int>(argc, argv, "--threads", to_string(max(1u, thread::hardware_concurrency())), valid);
+    string checkpoint = readOption(argc, argv, "--checkpoint", "evolve.ckpt");
+    string out = readOption(argc, argv, "--out", "evolved_policy.txt");
+    if (!valid)
+    {
+        return 1;
+    }
+    if (populationSize < 2 || games < 1 || threads < 1 || elites < 0 || elites > populationSize)
+    {
+        cout << "Invalid evolve options!" << endl;
+        return 1;
+    }
+
+    StrategySearch search(populationSize, seed, games, level, maxRounds);
+    string error;
+    if (ifstream(checkpoint) && !search.loadCheckpoint(checkpoint, error))
+    {
+        cout << error << endl;
+        return 1;
+    }
+    if (search.getGeneration() > 0)
+    {
+        cout << "Resuming from generation " << search.getGeneration() << endl;
+    }
+    cout << fixed << setprecision(4);
+    int best = 0;
+    while (true)
+    {
+        search.evaluate(threads);
+        best = search.best();
+        cout << "Generation " << search.getGeneration() << ": best fitness " << search.getFitness(best) << endl;
+        if (search.getGeneration() + 1 >= generations)
+        {
+            break;
+        }
+        search.breed(elites);
+        if (!search.saveCheckpoint(checkpoint))
+        {
+            cout << "Cannot write " << checkpoint << "!" << endl;
+            return 1;
+        }
+    }
+    if (!StrategySearch::exportPolicy(out, search.getPolicy(best), search.getFitness(best)))
+    {
+        cout << "Cannot write " << out << "!" << endl;
+        return 1;
+    }
+    cout << "Best policy -> " << out << endl;
+    return 0;
+}
+BatchEngine::BatchEngine(int gameCount, int level, const RuleSet* rules) : gameCount(gameCount), rules(rules)
+{
+    int size = level == 1 ? 5 : level == 2 ? 7 : level == 3 ? 9 : 11;
+    totalCells = size * size;
+    goalNumber = (totalCells + 1) / 2;
+    lanes = (gameCount + 7) / 8 * 8;
+    cellKind = new int32_t[(totalCells + 1) * lanes];
+    active = new int32_t[lanes]();
+    rounds = new int32_t[lanes]();
+    for (int s = 0; s < 2; ++s)
+    {
+        position[s] = new int32_t[lanes]();
+        points[s] = new int32_t[lanes]();
+        gold[s] = new int32_t[lanes]();
+        silver[s] = new int32_t[lanes]();
+        blocked[s] = new int32_t[lanes]();
+        reached[s] = new int32_t[lanes]();
+        for (int k = 0; k < HELPER_KINDS; ++k)
+        {
+            helpers[s][k] = new int32_t[lanes]();
+        }
+    }
+    history = new MoveHistory[lanes * 2];
+    activeBlocks = new int32_t[lanes / 8];
+    activeBlockCount = 0;
+    for (int i = 0; i < (totalCells + 1) * lanes; ++i)
+    {
+        cellKind[i] = EMPTY_CELL;
+    }
+}
+BatchEngine::~BatchEngine()
+{
+    delete[] cellKind;
+    delete[] active;
+    delete[] rounds;
+    for (int s = 0; s < 2; ++s)
+    {
+        delete[] position[s];
+        delete[] points[s];
+        delete[] gold[s];
+        delete[] silver[s];
+        delete[] blocked[s];
+        delete[] reached[s];
+        for (int k = 0; k < HELPER_KINDS; ++k)
+        {
+            delete[] helpers[s][k];
+        }
+    }
+    delete[] history;
+    delete[] activeBlocks;
+}
+bool BatchEngine::usesAvx2()
+{
+#ifdef __AVX2__
+    return true;
+#else
+    return false;
+#endif
+}
+void BatchEngine::load(int g, const AdventureQuest& game)
+{
+    const Board& board = game.getBoard();
+    for (int num = 1; num <= totalCells; ++num)
+    {
+        cellKind[num * lanes + g] = board.getKind(num);
+    }
+    for (int s = 0; s < 2; ++s)
+    {
+        const Player& p = game.players[s];
+        position[s][g] = p.currentNumber;
+        points[s][g] = p.points;
+        gold[s][g] = p.gold;
+        silver[s][g] = p.silver;
+        blocked[s][g] = p.blockedTurns;
+        reached[s][g] = p.hasReachedGoal;
+        history[g * 2 + s] = p.history;
+        for (int k = 0; k < HELPER_KINDS; ++k)
+        {
+            helpers[s][k][g] = 0;
+        }
+        for (int i = 0; i < p.invSize; ++i)
+        {
+            const Helper& helper = p.inventory[i];
+            helpers[s][helper.getKind() - KIND_SWORD][g] += helper.getKind() == KIND_SWORD ? helper.getUses() : 1;
+        }
+    }
+    rounds[g] = game.getRound();
+}
+void BatchEngine::recordMove(int seat, int g, int num)
+{
+    history[g * 2 + seat].push(num);
+}
+void BatchEngine::moveBack(int seat, int g, int cells)
+{
+    MoveHistory& moves = history[g * 2 + seat];
+    if (moves.size() <= 1)
+    {
+        return;
+    }
+    int movesToGoBack = min(cells, moves.size() - 1);
+    int newNum = moves.peek(movesToGoBack);
+    position[seat][g] = newNum;
+    moves.push(newNum);
+    moves.pop(movesToGoBack);
+}
+void BatchEngine::applyHurdle(int seat, int g, int kind)
+{
+    const HurdleRule& rule = rules->hurdle(kind);
+    int32_t& count = helpers[seat][rule.neutralizer - KIND_SWORD][g];
+    if (count > 0)
+    {
+        count--;
+        return;
+    }
+    blocked[seat][g] = max(blocked[seat][g], rule.blockTurns);
+    if (rule.pushBack > 0)
+    {
+        moveBack(seat, g, rule.pushBack);
+    }
+    points[seat][g] = max(points[seat][g] - rule.penalty, 0);
+}
+void BatchEngine::collect(int seat, int g, int num)
+{
+    recordMove(seat, g, num);
+    int32_t& cell = cellKind[num * lanes + g];
+    if (cell == KIND_GOLD || cell == KIND_SILVER)
+    {
+        cell = EMPTY_CELL;
+    }
+    else if (cell != EMPTY_CELL)
+    {
+        applyHurdle(seat, g, cell);
+    }
+}
+void BatchEngine::stepLane(int seat, int g)
+{
+    if (!active[g])
+    {
+        return;
+    }
+    if (blocked[seat][g] > 0)
+    {
+        blocked[seat][g]--;
+        return;
+    }
+    if (reached[seat][g])
+    {
+        return;
+    }
+    int next = position[seat][g] + (seat == 0 ? -1 : 1);
+    if (next < 1 || next > totalCells || (next == position[1 - seat][g] && next != goalNumber))
+    {
+        return;
+    }
+    position[seat][g] = next;
+    int kind = cellKind[next * lanes + g];
+    if (kind == KIND_GOLD)
+    {
+        gold[seat][g] += 1;
+        points[seat][g] += 10;
+    }
+    else if (kind == KIND_SILVER)
+    {
+        silver[seat][g] += 1;
+        points[seat][g] += 5;
+    }
+    collect(seat, g, next);
+    if (position[seat][g] == goalNumber)
+    {
+        reached[seat][g] = 1;
+    }
+}
+void BatchEngine::stepSeat(int seat)
+{
+#ifdef __AVX2__
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i step = _mm256_set1_epi32(seat == 0 ? -1 : 1);
+    const __m256i upper = _mm256_set1_epi32(totalCells + 1);
+    const __m256i goal = _mm256_set1_epi32(goalNumber);
+    const __m256i stride = _mm256_set1_epi32(lanes);
+    const __m256i goldKind = _mm256_set1_epi32(KIND_GOLD);
+    const __m256i silverKind = _mm256_set1_epi32(KIND_SILVER);
+    const __m256i empty = _mm256_set1_epi32(EMPTY_CELL);
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (int b = 0; b < activeBlockCount; ++b)
+    {
+        int g = activeBlocks[b] * 8;
+        __m256i live = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(active + g)), zero);
+        __m256i blk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocked[seat] + g));
+        __m256i isBlocked = _mm256_and_si256(live, _mm256_cmpgt_epi32(blk, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(blocked[seat] + g), _mm256_sub_epi32(blk, _mm256_and_si256(isBlocked, one)));
+
+        __m256i done = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(reached[seat] + g)), zero);
+        __m256i pos = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position[seat] + g));
+        __m256i opponent = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position[1 - seat] + g));
+        __m256i next = _mm256_add_epi32(pos, step);
+        __m256i inBounds = _mm256_and_si256(_mm256_cmpgt_epi32(next, zero), _mm256_cmpgt_epi32(upper, next));
+        __m256i atGoal = _mm256_cmpeq_epi32(next, goal);
+        __m256i occupied = _mm256_andnot_si256(atGoal, _mm256_cmpeq_epi32(next, opponent));
+        __m256i moving = _mm256_andnot_si256(_mm256_or_si256(isBlocked, done), _mm256_and_si256(live, inBounds));
+        moving = _mm256_andnot_si256(occupied, moving);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(moving));
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(next, stride), _mm256_add_epi32(_mm256_set1_epi32(g), laneOffsets));
+        __m256i kind = _mm256_mask_i32gather_epi32(empty, cellKind, index, moving, 4);
+        __m256i isGold = _mm256_and_si256(moving, _mm256_cmpeq_epi32(kind, goldKind));
+        __m256i isSilver = _mm256_and_si256(moving, _mm256_cmpeq_epi32(kind, silverKind));
+        __m256i gain = _mm256_or_si256(_mm256_and_si256(isGold, _mm256_set1_epi32(10)), _mm256_and_si256(isSilver, _mm256_set1_epi32(5)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(position[seat] + g), _mm256_blendv_epi8(pos, next, moving));
+        __m256i pts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(points[seat] + g));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(points[seat] + g), _mm256_add_epi32(pts, gain));
+        __m256i gld = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gold[seat] + g));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(gold[seat] + g), _mm256_sub_epi32(gld, isGold));
+        __m256i slv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(silver[seat] + g));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(silver[seat] + g), _mm256_sub_epi32(slv, isSilver));
+
+        alignas(32) int32_t nextLanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(nextLanes), next);
+        while (mask)
+        {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            collect(seat, g + lane, nextLanes[lane]);
+        }
+        __m256i landed = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position[seat] + g));
+        __m256i arrived = _mm256_and_si256(moving, _mm256_cmpeq_epi32(landed, goal));
+        __m256i fin = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(reached[seat] + g));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(reached[seat] + g), _mm256_or_si256(fin, _mm256_and_si256(arrived, one)));
+    }
+#else
+    for (int b = 0; b < activeBlockCount; ++b)
+    {
+        for (int g = activeBlocks[b] * 8; g < activeBlocks[b] * 8 + 8; ++g)
+        {
+            stepLane(seat, g);
+        }
+    }
+#endif
+}
+void BatchEngine::updateActive(int maxRounds)
+{
+    int kept = 0;
+    for (int b = 0; b < activeBlockCount; ++b)
+    {
+        int any = 0;
+        for (int g = activeBlocks[b] * 8; g < activeBlocks[b] * 8 + 8; ++g)
+        {
+            active[g] = g < gameCount && !(reached[0][g] && reached[1][g]) && rounds[g] < maxRounds;
+            any |= active[g];
+        }
+        if (any)
+        {
+            activeBlocks[kept++] = activeBlocks[b];
+        }
+    }
+    activeBlockCount = kept;
+}
+void BatchEngine::run(int maxRounds)
+{
+    activeBlockCount = lanes / 8;
+    for (int b = 0; b < activeBlockCount; ++b)
+    {
+        activeBlocks[b] = b;
+    }
+    updateActive(maxRounds);
+    while (activeBlockCount > 0)
+    {
+        for (int b = 0; b < activeBlockCount; ++b)
+        {
+            for (int g = activeBlocks[b] * 8; g < activeBlocks[b] * 8 + 8; ++g)
+            {
+                rounds[g] += active[g];
+            }
+        }
+        stepSeat(0);
+        stepSeat(1);
+        updateActive(maxRounds);
+    }
+}
+int BatchEngine::getWinner(int g) const
+{
+    if (reached[0][g] && points[0][g] > points[1][g])
+    {
+        return 0;
+    }
+    if (reached[1][g] && points[1][g] > points[0][g])
+    {
+        return 1;
+    }
+    return -1;
+}
+bool BatchEngine::matches(int g, const AdventureQuest& game) const
+{
+    if (rounds[g] != game.getRound() || getWinner(g) != game.getWinner())
+    {
+        return false;
+    }
+    for (int s = 0; s < 2; ++s)
+    {
+        const Player& p = game.players[s];
+        if (position[s][g] != p.currentNumber || points[s][g] != p.points || gold[s][g] != p.gold || silver[s][g] != p.silver || blocked[s][g] != p.blockedTurns || (reached[s][g] != 0) != p.hasReachedGoal)
+        {
+            return false;
+        }
+        int counts[HELPER_KINDS] = { 0, 0, 0, 0 };
+        for (int i = 0; i < p.invSize; ++i)
+        {
+            const Helper& helper = p.inventory[i];
+            counts[helper.getKind() - KIND_SWORD] += helper.getKind() == KIND_SWORD ? helper.getUses() : 1;
+        }
+        for (int k = 0; k < HELPER_KINDS; ++k)
+        {
+            if (counts[k] != helpers[s][k][g])
+            {
+                return false;
+            }
+        }
+    }
+    const Board& board = game.getBoard();
+    for (int num = 1; num <= totalCells; ++num)
+    {
+        if (board.getKind(num) != cellKind[num * lanes + g])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+int runBatchBenchmark(int argc, char* argv[])
+{
+    bool valid = true;
+    int games = readNumber<int>(argc, argv, "--games", "20000", valid);
+    int level = readNumber<int>(argc, argv, "--level", "2", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    int warmup = readNumber<int>(argc, argv, "--warmup", "8", valid);
+    int maxRounds = readNumber<int>(argc, argv, "--max-rounds", "1000", valid);
+    int chunk = readNumber<int>(argc, argv, "--chunk", "4096", valid);
+    string rulesFile = readOption(argc, argv, "--rules", "");
+    if (!valid)
+    {
+        return 1;
+    }
+    if (level < 1 || level > 4 || games < 1 || chunk < 1)
+    {
+        cout << "Invalid batch options!" << endl;
+        return 1;
+    }
+    RuleSet rules = DEFAULT_RULES;
+    if (!rulesFile.empty())
+    {
+        RuleSweep sweep;
+        string error;
+        if (!sweep.load(rulesFile, error))
+        {
+            cout << error << endl;
+            return 1;
+        }
+        if (sweep.gridSize() != 1)
+        {
+            cout << "Every rule in " << rulesFile << " needs a single value!" << endl;
+            return 1;
+        }
+        sweep.enumerate();
+        sweep.apply(0, rules);
+    }
+
+    double scalarSeconds = 0.0;
+    double batchSeconds = 0.0;
+    int mismatches = 0;
+    MoveBot mover;
+    for (int first = 0; first < games; first += chunk)
+    {
+        int count = min(chunk, games - first);
+        AdventureQuest** chunkGames = new AdventureQuest * [count];
+        BatchEngine engine(count, level, &rules);
+        for (int i = 0; i < count; ++i)
+        {
+            uint64_t gameSeed = Rng::mix(seed, static_cast<uint64_t>(first + i));
+            chunkGames[i] = new AdventureQuest(level, gameSeed, 2, &rules);
+            RandomBot bot(Rng::mix(gameSeed, 1), 30, 30);
+            chunkGames[i]->runSimulation(bot, warmup);
+            engine.load(i, *chunkGames[i]);
+        }
+
+        clock_t start = clock();
+        for (int i = 0; i < count; ++i)
+        {
+            chunkGames[i]->runSimulation(mover, maxRounds);
+        }
+        scalarSeconds += static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        engine.run(maxRounds);
+        batchSeconds += static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (!engine.matches(i, *chunkGames[i]))
+            {
+                mismatches++;
+            }
+            delete chunkGames[i];
+        }
+        delete[] chunkGames;
+    }
+
+    cout << "Batch engine (" << (BatchEngine::usesAvx2() ? "AVX2" : "scalar") << "), level " << level << ", " << games << " games" << endl;
+    cout << fixed << setprecision(0);
+    cout << "Scalar AdventureQuest: " << games / max(scalarSeconds, 1e-9) << " games/s" << endl;
+    cout << "Batch engine:          " << games / max(batchSeconds, 1e-9) << " games/s" << endl;
+    cout << "Mismatched games: " << mismatches << endl;
+    return mismatches == 0 ? 0 : 1;
+}
+class TrainingEnv
+{
+public:
+    static const int GRID = 11;
+    static const int CELLS = GRID * GRID;
+    static const int PLANES = 13;
+    static const int SEAT_FEATURES = 6 + HELPER_KINDS;
+    static const int ACTION_COUNT = 1 + HELPER_KINDS + HURDLE_KINDS * CELLS;
+
+private:
+    AdventureQuest game;
+    Bot* bots[AdventureQuest::MAX_PLAYERS];
+    uint64_t seed;
+    long long episode;
+    int level;
+    int maxRounds;
+    int lastPoints;
+
+    TurnAction decode(int action) const;
+    bool isWaiting(int seat) const;
+    void playOpponents();
+    bool isDone() const;
+
+public:
+    TrainingEnv(int level, uint64_t seed, int playerCount, const string& opponent, int maxRounds);
+    TrainingEnv(const TrainingEnv&) = delete;
+    TrainingEnv& operator=(const TrainingEnv&) = delete;
+    ~TrainingEnv();
+    bool isValid() const { return bots[1] != nullptr; }
+    int getPlayerCount() const { return game.getPlayerCount(); }
+    int observationSize() const { return PLANES * CELLS + 2 + SEAT_FEATURES * game.getPlayerCount(); }
+    void reset();
+    void step(int action, float& reward, uint8_t& done);
+    void observe(float* out) const;
+};
+TrainingEnv::TrainingEnv(int level, uint64_t seed, int playerCount, const string& opponent, int maxRounds) : game(level, seed, playerCount), seed(seed), episode(0), level(level), maxRounds(maxRounds), lastPoints(0)
+{
+    bots[0] = nullptr;
+    for (int seat = 1; seat < game.getPlayerCount(); ++seat)
+    {
+        bots[seat] = makeBot(opponent, Rng::mix(seed, static_cast<uint64_t>(seat)), 0, 2);
+    }
+    game.reserveHistory(4 * maxRounds + CELLS);
+    reset();
+}
+TrainingEnv::~TrainingEnv()
+{
+    for (int seat = 1; seat < game.getPlayerCount(); ++seat)
+    {
+        delete bots[seat];
+    }
+}
+void TrainingEnv::reset()
+{
+    game.restart(level, Rng::mix(seed, static_cast<uint64_t>(episode++)));
+    game.beginRound();
+    lastPoints = game.getPlayer(0).getPoints();
+}
+TurnAction TrainingEnv::decode(int action) const
+{
+    if (action <= 0 || action >= ACTION_COUNT)
+    {
+        return { ACTION_MOVE, 0, 0 };
+    }
+    if (action <= HELPER_KINDS)
+    {
+        return { ACTION_BUY_HELPER, action, 0 };
+    }
+    int index = action - 1 - HELPER_KINDS;
+    int cell = game.getBoard().positionToNumber(index % CELLS / GRID, index % CELLS % GRID);
+    if (cell < 0)
+    {
+        return { ACTION_NONE, 0, 0 };
+    }
+    return { ACTION_PLACE_HURDLE, 1 + index / CELLS, cell };
+}
+bool TrainingEnv::isWaiting(int seat) const
+{
+    const Player& player = game.getPlayer(seat);
+    return player.isBlocked() || player.hasReachedGoalState();
+}
+void TrainingEnv::playOpponents()
+{
+    for (int seat = 1; seat < game.getPlayerCount(); ++seat)
+    {
+        if (isWaiting(seat))
+        {
+            game.stepTurn(seat, { ACTION_NONE, 0, 0 });
+        }
+        else
+        {
+            game.applyAction(seat, bots[seat]->chooseAction(game, seat));
+        }
+    }
+}
+bool TrainingEnv::isDone() const
+{
+    return game.isFinished() || game.getRound() >= maxRounds;
+}
+void TrainingEnv::step(int action, float& reward, uint8_t& done)
+{
+    game.applyAction(0, decode(action));
+    playOpponents();
+    while (!isDone())
+    {
+        game.beginRound();
+        if (!isWaiting(0))
+        {
+            break;
+        }
+        game.stepTurn(0, { ACTION_NONE, 0, 0 });
+        playOpponents();
+    }
+
+    int points = game.getPlayer(0).getPoints();
+    reward = (points - lastPoints) / 100.0f;
+    lastPoints = points;
+    done = isDone() ? 1 : 0;
+    if (done)
+    {
+        int winner = game.getWinner();
+        reward += winner == 0 ? 1.0f : winner > 0 ? -1.0f : 0.0f;
+        reset();
+    }
+}
+void TrainingEnv::observe(float* out) const
+{
+    static const ItemKind PLANE_KINDS[7] = { KIND_GOLD, KIND_SILVER, KIND_FIRE, KIND_SNAKE, KIND_GHOST, KIND_LION, KIND_LOCK };
+    fill(out, out + observationSize(), 0.0f);
+    const Board& board = game.getBoard();
+    int playerCount = game.getPlayerCount();
+    auto mark = [&](int plane, BitBoard cells)
+    {
+        while (cells.any())
+        {
+            pair<int, int> pos = board.numberToPosition(cells.takeLowest());
+            out[plane * CELLS + pos.first * GRID + pos.second] = 1.0f;
+        }
+    };
+    for (int plane = 0; plane < 7; ++plane)
+    {
+        mark(plane, board.getMask(PLANE_KINDS[plane]));
+    }
+    for (int x = 0; x < board.getSize(); ++x)
+    {
+        fill(out + 7 * CELLS + x * GRID, out + 7 * CELLS + x * GRID + board.getSize(), 1.0f);
+    }
+    mark(8, BitBoard::cell(game.getGoalNumber()));
+    for (int seat = 0; seat < playerCount; ++seat)
+    {
+        mark(seat == 0 ? 9 : 10, game.getPlayer(seat).getPath());
+    }
+
+    float* scalars = out + PLANES * CELLS;
+    scalars[0] = static_cast<float>(game.getRound()) / maxRounds;
+    scalars[1] = static_cast<float>(game.getBoardLevel());
+    for (int seat = 0; seat < playerCount; ++seat)
+    {
+        const Player& player = game.getPlayer(seat);
+        out[(seat == 0 ? 11 : 12) * CELLS + player.getX() * GRID + player.getY()] += 1.0f;
+        float* features = scalars + 2 + seat * SEAT_FEATURES;
+        features[0] = static_cast<float>(player.getPoints());
+        features[1] = static_cast<float>(player.getGold());
+        features[2] = static_cast<float>(player.getSilver());
+        features[3] = static_cast<float>(player.getBlockedTurns());
+        features[4] = static_cast<float>(abs(game.getGoalNumber() - player.getCurrentNumber()));
+        features[5] = player.hasReachedGoalState() ? 1.0f : 0.0f;
+        for (int i = 0; i < player.getInventorySize(); ++i)
+        {
+            const Helper* helper = player.getInventoryItem(i);
+            features[6 + helper->getKind() - KIND_SWORD] += static_cast<float>(helper->getUses());
+        }
+    }
+}
+class VecEnv
+{
+private:
+    TrainingEnv** envs;
+    int count;
+    int threads;
+    thread* pool;
+    mutex lock;
+    condition_variable wake;
+    condition_variable idle;
+    long long generation;
+    int running;
+    bool stopping;
+    const int32_t* actions;
+    float* observations;
+    float* rewards;
+    uint8_t* dones;
+
+    void runShare(int worker);
+    void worker(int index);
+    void dispatch();
+
+public:
+    VecEnv(int count, const uint64_t* seeds, int level, int playerCount, const string& opponent, int maxRounds, int threads);
+    VecEnv(const VecEnv&) = delete;
+    VecEnv& operator=(const VecEnv&) = delete;
+    ~VecEnv();
+    bool isValid() const;
+    int observationSize() const { return envs[0]->observationSize(); }
+    void reset(float* observations);
+    void step(const int32_t* actions, float* observations, float* rewards, uint8_t* dones);
+};
+VecEnv::VecEnv(int count, const uint64_t* seeds, int level, int playerCount, const string& opponent, int maxRounds, int threads) : count(count), threads(max(1, min(threads, count))), generation(0), running(0), stopping(false), actions(nullptr), observations(nullptr), rewards(nullptr), dones(nullptr)
+{
+    envs = new TrainingEnv * [count];
+    for (int e = 0; e < count; ++e)
+    {
+        envs[e] = new TrainingEnv(level, seeds[e], playerCount, opponent, maxRounds);
+    }
+    pool = new thread[this->threads - 1];
+    for (int t = 1; t < this->threads; ++t)
+    {
+        pool[t - 1] = thread(&VecEnv::worker, this, t);
+    }
+}
+VecEnv::~VecEnv()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (int t = 1; t < threads; ++t)
+    {
+        pool[t - 1].join();
+    }
+    delete[] pool;
+    for (int e = 0; e < count; ++e)
+    {
+        delete envs[e];
+    }
+    delete[] envs;
+}
+bool VecEnv::isValid() const
+{
+    for (int e = 0; e < count; ++e)
+    {
+        if (!envs[e]->isValid() || envs[e]->observationSize() != envs[0]->observationSize())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+void VecEnv::runShare(int worker)
+{
+    GameLog::setQuiet(true);
+    int size = observationSize();
+    for (int e = static_cast<int>(static_cast<long long>(count) * worker / threads); e < static_cast<long long>(count) * (worker + 1) / threads; ++e)
+    {
+        if (actions)
+        {
+            envs[e]->step(actions[e], rewards[e], dones[e]);
+        }
+        envs[e]->observe(observations + static_cast<size_t>(e) * size);
+    }
+}
+void VecEnv::worker(int index)
+{
+    long long seen = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [&]() { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+        }
+        runShare(index);
+        lock_guard<mutex> guard(lock);
+        if (--running == 0)
+        {
+            idle.notify_one();
+        }
+    }
+}
+void VecEnv::dispatch()
+{
+    if (threads > 1)
+    {
+        lock_guard<mutex> guard(lock);
+        running = threads - 1;
+        generation++;
+    }
+    wake.notify_all();
+    runShare(0);
+    unique_lock<mutex> guard(lock);
+    idle.wait(guard, [&]() { return running == 0; });
+}
+void VecEnv::reset(float* observations)
+{
+    for (int e = 0; e < count; ++e)
+    {
+        envs[e]->reset();
+    }
+    this->actions = nullptr;
+    this->observations = observations;
+    dispatch();
+}
+void VecEnv::step(const int32_t* actions, float* observations, float* rewards, uint8_t* dones)
+{
+    this->actions = actions;
+    this->observations = observations;
+    this->rewards = rewards;
+    this->dones = dones;
+    dispatch();
+}
+#if defined(_WIN32)
+#define AQ_EXPORT __declspec(dllexport)
+#else
+#define AQ_EXPORT __attribute__((visibility("default")))
+#endif
+extern "C"
+{
+    AQ_EXPORT VecEnv* aq_create(int count, const uint64_t* seeds, int level, int players, const char* opponent, int maxRounds, int threads)
+    {
+        if (count < 1 || !seeds || level < 1 || level > 4 || maxRounds < 1)
+        {
+            return nullptr;
+        }
+        VecEnv* env = new VecEnv(count, seeds, level, players, opponent ? opponent : "random", maxRounds, threads);
+        if (!env->isValid())
+        {
+            delete env;
+            return nullptr;
+        }
+        return env;
+    }
+    AQ_EXPORT void aq_destroy(VecEnv* env)
+    {
+        delete env;
+    }
+    AQ_EXPORT int aq_observation_size(const VecEnv* env)
+    {
+        return env->observationSize();
+    }
+    AQ_EXPORT int aq_action_count()
+    {
+        return TrainingEnv::ACTION_COUNT;
+    }
+    AQ_EXPORT void aq_reset(VecEnv* env, float* observations)
+    {
+        env->reset(observations);
+    }
+    AQ_EXPORT void aq_step(VecEnv* env, const int32_t* actions, float* observations, float* rewards, uint8_t* dones)
+    {
+        env->step(actions, observations, rewards, dones);
+    }
+}
+int runEnvBenchmark(int argc, char* argv[])
+{
+    bool valid = true;
+    int count = readNumber<int>(argc, argv, "--envs", "256", valid);
+    int steps = readNumber<int>(argc, argv, "--steps", "2000", valid);
+    int level = readNumber<int>(argc, argv, "--level", "2", valid);
+    int playerCount = readNumber<int>(argc, argv, "--players", "2", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    int threads = readNumber<int>(argc, argv, "--threads", to_string(max(1u, thread::hardware_concurrency())), valid);
+    string opponent = readOption(argc, argv, "--bot", "random");
+    if (!valid)
+    {
+        return 1;
+    }
+    if (count < 1 || steps < 1)
+    {
+        cout << "Invalid environment options!" << endl;
+        return 1;
+    }
+
+    uint64_t* seeds = new uint64_t[count];
+    for (int e = 0; e < count; ++e)
+    {
+        seeds[e] = Rng::mix(seed, static_cast<uint64_t>(e));
+    }
+    VecEnv* env = aq_create(count, seeds, level, playerCount, opponent.c_str(), 1000, threads);
+    delete[] seeds;
+    if (!env)
+    {
+        cout << "Cannot create environments!" << endl;
+        return 1;
+    }
+    int size = aq_observation_size(env);
+    float* observations = new float[static_cast<size_t>(count) * size];
+    float* rewards = new float[count];
+    uint8_t* dones = new uint8_t[count];
+    int32_t* actions = new int32_t[count];
+    aq_reset(env, observations);
+
+    Rng rng(seed);
+    long long episodes = 0;
+    double totalReward = 0.0;
+    double seconds = 0.0;
+    for (int s = 0; s < steps; ++s)
+    {
+        for (int e = 0; e < count; ++e)
+        {
+            actions[e] = rng.nextInt(10) == 0 ? rng.nextInt(aq_action_count()) : 0;
+        }
+        auto started = chrono::steady_clock::now();
+        aq_step(env, actions, observations, rewards, dones);
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        for (int e = 0; e < count; ++e)
+        {
+            episodes += dones[e];
+            totalReward += rewards[e];
+        }
+    }
+
+    cout << count << " environments, level " << level << ", " << size << " floats per observation, " << aq_action_count() << " actions" << endl;
+    cout << fixed << setprecision(0) << static_cast<double>(count) * steps / max(seconds, 1e-9) << " steps/s on " << threads << " threads" << endl;
+    cout << setprecision(3) << episodes << " episodes, mean reward per step " << totalReward / (static_cast<double>(count) * steps) << endl;
+
+    delete[] observations;
+    delete[] rewards;
+    delete[] dones;
+    delete[] actions;
+    aq_destroy(env);
+    return 0;
+}
+const int FUZZ_MAX_ACTIONS = 10;
+const int FUZZ_FULL_CHECK_INTERVAL = 8;
+int fuzzActions(const uint8_t* data, size_t size)
+{
+    if (size < 3)
+    {
+        return 0;
+    }
+    static thread_local unique_ptr<AdventureQuest> games[9];
+    static thread_local unique_ptr<Board> boards[4 * 256];
+    int playerCount = 2 + data[1] % 7;
+    if (!games[playerCount])
+    {
+        games[playerCount] = make_unique<AdventureQuest>(1, 0, playerCount);
+    }
+    AdventureQuest& game = *games[playerCount];
+    int level = 1 + data[0] % 4;
+    unique_ptr<Board>& start = boards[(level - 1) * 256 + data[2]];
+    if (!start)
+    {
+        start = make_unique<Board>(level, Rng::mix(data[2], static_cast<uint64_t>(level)));
+    }
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    game.restart(*start);
+    int actions = 0;
+    for (size_t i = 3; i + 2 < size && actions < FUZZ_MAX_ACTIONS; i += 3)
+    {
+        actions++;
+        int seat = data[i] >> 3;
+        seat %= game.getPlayerCount();
+        int a = data[i + 1];
+        int b = data[i + 2];
+        uint64_t touched = 1ULL << seat;
+        switch (data[i] & 7) {
+        case 0:
+        case 1: game.stepTurn(seat, { ACTION_MOVE, 0, 0 }); break;
+        case 2: game.stepTurn(seat, { ACTION_PLACE_HURDLE, a % 7, b }); break;
+        case 3: game.stepTurn(seat, { ACTION_BUY_HELPER, a % 6, 0 }); break;
+        case 4: game.stepTurn(seat, { ACTION_USE_ITEM, a % 12, 0 }); break;
+        case 5: game.saveGame(); touched = 0; break;
+        case 6: game.loadGame(); touched = ~0ULL; break;
+        default:
+            if (a % 8 == 0)
+            {
+                game.levelUp();
+                touched = ~0ULL;
+            }
+            else if (a % 8 == 1)
+            {
+                size_t length = min(static_cast<size_t>(b % 16), size - (i + 3));
+                string script(reinterpret_cast<const char*>(data + i + 3), length);
+                i += length;
+                string error;
+                if (game.queueScript(seat, script, error))
+                {
+                    while (game.getQueuedCount(seat) > 0)
+                    {
+                        game.playTurn(seat);
+                    }
+                }
+            }
+            else if (a % 8 == 2)
+            {
+                RandomBot bot(b);
+                game.runSimulation(bot, game.getRound() + 1 + b % 8);
+                touched = ~0ULL;
+            }
+            else
+            {
+                game.stepTurn(seat, { a % 5, b % 7, b });
+            }
+            break;
+        }
+        bool fullCheck = touched == ~0ULL || actions % FUZZ_FULL_CHECK_INTERVAL == 0 || actions == FUZZ_MAX_ACTIONS || i + 5 >= size;
+        if (const char* violation = fullCheck ? game.checkInvariants() : touched ? game.checkInvariants(touched) : nullptr)
+        {
+            cerr << "Invariant violated after action at byte " << i << ": " << violation << endl;
+            abort();
+        }
+    }
+    GameLog::setQuiet(wasQuiet);
+    return 0;
+}
+class ReplicaBot : public Bot
+{
+private:
+    uint64_t seed;
+    int copyAt;
+    int decisions;
+
+public:
+    unique_ptr<AdventureQuest> replica;
+    int replicaSeat;
+
+    ReplicaBot(uint64_t seed, int copyAt) : seed(seed), copyAt(copyAt), decisions(0), replicaSeat(-1) {}
+    TurnAction chooseAction(const AdventureQuest& game, int seat) override
+    {
+        if (decisions++ == copyAt)
+        {
+            replica = make_unique<AdventureQuest>(game);
+            replicaSeat = seat;
+        }
+        return decide(game, seat, game.getRound(), seed);
+    }
+    static TurnAction decide(const AdventureQuest& game, int seat, int round, uint64_t seed)
+    {
+        RandomBot bot(Rng::mix(seed, static_cast<uint64_t>(round) * AdventureQuest::MAX_PLAYERS + seat), 3, 4);
+        return bot.chooseAction(game, seat);
+    }
+};
+bool checkMidRoundCopy(uint64_t seed, int maxRounds)
+{
+    AdventureQuest game(1 + seed % 4, seed, 2 + seed % 3);
+    ReplicaBot bot(seed, 3 + static_cast<int>(seed % 29));
+    game.runSimulation(bot, maxRounds);
+    if (!bot.replica)
+    {
+        return true;
+    }
+    AdventureQuest& replica = *bot.replica;
+    int playerCount = replica.getPlayerCount();
+    int round = replica.getRound();
+    for (int seat = bot.replicaSeat; seat < playerCount; ++seat)
+    {
+        replica.stepTurn(seat, ReplicaBot::decide(replica, seat, round, seed));
+    }
+    for (int turn = round * playerCount; !replica.isFinished() && turn < maxRounds * playerCount; ++turn)
+    {
+        replica.replayTurn(turn, ReplicaBot::decide(replica, turn % playerCount, turn / playerCount + 1, seed));
+    }
+    string original;
+    string copy;
+    game.writeState(original);
+    replica.writeState(copy);
+    return original == copy;
+}
+const char* runSelfChecks()
+{
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    const char* failure = nullptr;
+    for (uint64_t seed = 1; seed <= 4 && !failure; ++seed)
+    {
+        AdventureQuest game(1 + seed % 4, seed, 2);
+        SearchBot search(1);
+        RandomBot random(seed);
+        Bot* bots[2] = { &search, &random };
+        game.runSimulation(bots, 40);
+        failure = game.checkInvariants();
+    }
+    for (uint64_t seed = 1; seed <= 200 && !failure; ++seed)
+    {
+        if (!checkMidRoundCopy(seed, 120))
+        {
+            failure = "a mid-round copy played to the end diverged from the original";
+        }
+    }
+    GameLog::setQuiet(wasQuiet);
+    return failure;
+}
+#ifdef AQ_FUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    return fuzzActions(data, size);
+}
+#endif
+int runFuzz(int argc, char* argv[])
+{
+    int files = 0;
+    for (int i = 2; i < argc && string(argv[i]).compare(0, 2, "--") != 0; ++i)
+    {
+        ifstream in(argv[i], ios::binary);
+        if (!in)
+        {
+            cout << "Cannot open " << argv[i] << "!" << endl;
+            return 1;
+        }
+        string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        fuzzActions(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+        files++;
+    }
+    if (files > 0)
+    {
+        cout << "Replayed " << files << " inputs" << endl;
+        return 0;
+    }
+
+    if (const char* failure = runSelfChecks())
+    {
+        cout << "Self-check failed: " << failure << endl;
+        return 1;
+    }
+
+    bool valid = true;
+    long long runs = readNumber<long long>(argc, argv, "--runs", "100000", valid);
+    int maxLength = readNumber<int>(argc, argv, "--max-len", "32", valid);
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    if (!valid)
+    {
+        return 1;
+    }
+    Rng rng(seed);
+    uint8_t* buffer = new uint8_t[max(maxLength, 3)];
+    clock_t start = clock();
+    for (long long run = 0; run < runs; ++run)
+    {
+        int length = 3 + rng.nextInt(max(maxLength - 2, 1));
+        for (int i = 0; i < length; ++i)
+        {
+            buffer[i] = static_cast<uint8_t>(rng.next());
+        }
+        fuzzActions(buffer, length);
+    }
+    double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    delete[] buffer;
+    cout << "Ran " << runs << " random inputs (" << static_cast<long long>(runs / max(seconds, 1e-9)) << " execs/s), no invariant violations" << endl;
+    return 0;
+}
+bool StatePublisher::open(const string& name, string& error)
+{
+    close();
+#ifdef AQ_SHARED_MEMORY
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        error = "cannot create shared memory " + name + ": " + strerror(errno);
+        return false;
+    }
+    if (ftruncate(fd, sizeof(SharedRegion)) != 0)
+    {
+        error = "cannot size shared memory " + name + ": " + strerror(errno);
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* mapping = mmap(nullptr, sizeof(SharedRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        error = "cannot map shared memory " + name + ": " + strerror(errno);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    region = new (mapping) SharedRegion();
+    region->magic = SharedRegion::MAGIC;
+    region->snapshotSize = sizeof(SharedSnapshot);
+    region->writerActive.store(1, memory_order_release);
+    this->name = name;
+    return true;
+#else
+    error = "shared memory is not supported on this platform";
+    return false;
+#endif
+}
+void StatePublisher::close()
+{
+#ifdef AQ_SHARED_MEMORY
+    if (region)
+    {
+        region->writerActive.store(0, memory_order_release);
+        munmap(region, sizeof(SharedRegion));
+        shm_unlink(name.c_str());
+        region = nullptr;
+    }
+#endif
+}
+void StatePublisher::publish(const AdventureQuest& game)
+{
+    uint32_t sequence = region->sequence.load(memory_order_relaxed);
+    region->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    SharedSnapshot& snapshot = region->snapshot;
+    const Board& board = game.getBoard();
+    int size = board.getSize();
+    snapshot.level = board.getLevel();
+    snapshot.boardSize = size;
+    snapshot.round = game.getRound();
+    snapshot.goalNumber = game.getGoalNumber();
+    snapshot.playerCount = game.getPlayerCount();
+    snapshot.finished = game.isFinished();
+    for (int x = 0; x < size; ++x)
+    {
+        for (int y = 0; y < size; ++y)
+        {
+            snapshot.cellNumbers[x * size + y] = static_cast<uint8_t>(board.positionToNumber(x, y));
+        }
+    }
+    for (int num = 1; num <= size * size; ++num)
+    {
+        snapshot.kinds[num] = static_cast<uint8_t>(board.getKind(num));
+    }
+    for (int seat = 0; seat < game.getPlayerCount(); ++seat)
+    {
+        const Player& player = game.getPlayer(seat);
+        SharedPlayer& shared = snapshot.players[seat];
+        shared.cell = player.getCurrentNumber();
+        shared.points = player.getPoints();
+        shared.gold = player.getGold();
+        shared.silver = player.getSilver();
+        shared.blockedTurns = game.getBlockedTurns(seat);
+        shared.reachedGoal = player.hasReachedGoalState();
+        shared.inventorySize = static_cast<uint8_t>(min(player.getInventorySize(), SharedPlayer::INVENTORY_SLOTS));
+        for (int i = 0; i < shared.inventorySize; ++i)
+        {
+            const Helper* helper = player.getInventoryItem(i);
+            shared.inventory[i] = static_cast<uint8_t>(helper->getKind());
+            shared.uses[i] = static_cast<uint8_t>(helper->getUses());
+        }
+    }
+
+    region->sequence.store(sequence + 2, memory_order_release);
+}
+bool StateReader::open(const string& name, string& error)
+{
+    close();
+#ifdef AQ_SHARED_MEMORY
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        error = "cannot open shared memory " + name + ": " + strerror(errno);
+        return false;
+    }
+    void* mapping = mmap(nullptr, sizeof(SharedRegion), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        error = "cannot map shared memory " + name + ": " + strerror(errno);
+        return false;
+    }
+    region = static_cast<const SharedRegion*>(mapping);
+    if (region->magic != SharedRegion::MAGIC || region->snapshotSize != sizeof(SharedSnapshot))
+    {
+        error = name + " was not written by this version of the game";
+        close();
+        return false;
+    }
+    return true;
+#else
+    error = "shared memory is not supported on this platform";
+    return false;
+#endif
+}
+void StateReader::close()
+{
+#ifdef AQ_SHARED_MEMORY
+    if (region)
+    {
+        munmap(const_cast<SharedRegion*>(region), sizeof(SharedRegion));
+        region = nullptr;
+    }
+#endif
+}
+bool StateReader::read(SharedSnapshot& out, uint32_t& sequence) const
+{
+    for (int attempt = 0; attempt < 1000; ++attempt)
+    {
+        uint32_t before = region->sequence.load(memory_order_acquire);
+        if (before & 1)
+        {
+            this_thread::yield();
+            continue;
+        }
+        memcpy(&out, &region->snapshot, sizeof(SharedSnapshot));
+        atomic_thread_fence(memory_order_acquire);
+        if (region->sequence.load(memory_order_relaxed) == before)
+        {
+            sequence = before;
+            return true;
+        }
+    }
+    return false;
+}
+void printSnapshot(const SharedSnapshot& snapshot)
+{
+    static const char* const PATH_COLORS[] = { RED, BLUE, YELLOW, MAGENTA, CYAN };
+    int size = snapshot.boardSize;
+    int occupant[11 * 11 + 1];
+    for (int num = 0; num <= size * size; ++num)
+    {
+        occupant[num] = -1;
+    }
+    for (int p = snapshot.playerCount - 1; p >= 0; --p)
+    {
+        occupant[snapshot.players[p].cell] = p;
+    }
+
+    cout << "Level " << snapshot.level << ", round " << snapshot.round << (snapshot.finished ? " (finished)" : "") << endl;
+    for (int i = 0; i < size; ++i)
+    {
+        for (int j = 0; j < size; ++j)
+        {
+            cout << "+-----";
+        }
+        cout << "+" << endl;
+        for (int j = 0; j < size; ++j)
+        {
+            int num = snapshot.cellNumbers[i * size + j];
+            cout << "| ";
+            if (occupant[num] >= 0)
+            {
+                cout << BOLD << PATH_COLORS[occupant[num] % 5] << "P" << setw(2) << left << occupant[num] + 1 << right << RESET;
+            }
+            else if (num == snapshot.goalNumber)
+            {
+                cout << GREEN << "GOL" << RESET;
+            }
+            else
+            {
+                cout << ITEM_SHORT_NAMES[min<int>(snapshot.kinds[num], KIND_COUNT)];
+            }
+            cout << " ";
+        }
+        cout << "|" << endl;
+    }
+    for (int j = 0; j < size; ++j)
+    {
+        cout << "+-----";
     }
-    else
+    cout << "+" << endl;
+
+    for (int p = 0; p < snapshot.playerCount; ++p)
     {
-        player.useSword();
+        const SharedPlayer& player = snapshot.players[p];
+        cout << "P" << p + 1 << ": cell " << player.cell << ", points " << player.points << ", gold " << player.gold << ", silver " << player.silver;
+        if (player.blockedTurns > 0)
+        {
+            cout << ", blocked " << player.blockedTurns;
+        }
+        if (player.reachedGoal)
+        {
+            cout << ", at goal";
+        }
+        for (int i = 0; i < player.inventorySize; ++i)
+        {
+            cout << (i == 0 ? " [" : ", ") << ITEM_NAMES[min<int>(player.inventory[i], KIND_COUNT)];
+            if (player.uses[i] > 0)
+            {
+                cout << " (" << static_cast<int>(player.uses[i]) << ")";
+            }
+        }
+        cout << (player.inventorySize > 0 ? "]" : "") << endl;
     }
 }
-Item* Snake::clone() const
-{
-    return new Snake(*this);
-}
-Ghost::Ghost(int x, int y) : Hurdle(x, y, 20, 20, 1)
-{
-    name = "Ghost";
-}
-void Ghost::interact(Player& player)
-{
-    Hurdle::interact(player);
-}
-void Ghost::applyEffect(Player& player)
+int runSpectator(int argc, char* argv[])
 {
-    if (!player.hasShield())
+    string name = argc > 2 && string(argv[2]).compare(0, 2, "--") != 0 ? argv[2] : "/adventure-quest";
+    bool valid = true;
+    int interval = readNumber<int>(argc, argv, "--interval", "100", valid);
+    long long frames = readNumber<long long>(argc, argv, "--frames", "0", valid);
+    bool clear = readOption(argc, argv, "--clear", "1") != "0";
+    if (!valid)
     {
-        player.block(getBlockTurns());
-        player.deductPoints(getPenalty());
-        cout << "Blocked by Ghost! -20 points, wait 1 turn." << endl;
+        return 1;
     }
-    else
+
+    StateReader reader;
+    string error;
+    if (!reader.open(name, error))
+    {
+        cout << "Cannot spectate: " << error << endl;
+        return 1;
+    }
+    SharedSnapshot* snapshot = new SharedSnapshot;
+    uint32_t shown = 0;
+    long long drawn = 0;
+    while (frames == 0 || drawn < frames)
     {
-        player.useShield();
+        bool active = reader.isWriterActive();
+        uint32_t sequence;
+        if (reader.read(*snapshot, sequence) && sequence != shown)
+        {
+            shown = sequence;
+            drawn++;
+            if (clear)
+            {
+                cout << "\033[H\033[2J";
+            }
+            printSnapshot(*snapshot);
+            cout << flush;
+        }
+        if (!active)
+        {
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(interval));
     }
+    delete snapshot;
+    return 0;
 }
-Item* Ghost::clone() const
+struct Migration
 {
-    return new Ghost(*this);
-}
-Lion::Lion(int x, int y) : Hurdle(x, y, 50, 50, 4)
+    Player* player;
+    int region;
+};
+class MigrationQueue
 {
-    name = "Lion";
-}
-void Lion::interact(Player& player)
+private:
+    static constexpr size_t CAPACITY = 1024;
+    alignas(64) atomic<size_t> head;
+    alignas(64) atomic<size_t> tail;
+    Migration slots[CAPACITY];
+
+public:
+    MigrationQueue() : head(0), tail(0) {}
+    bool push(const Migration& migration);
+    bool pop(Migration& migration);
+};
+bool MigrationQueue::push(const Migration& migration)
 {
-    if (player.getPoints() >= getCost() && player.getGold() >= 1)
-    {
-        player.deductPoints(getCost());
-        player.deductGold(1);
-        player.placeHurdle(this->clone());
-    }
-    else
+    size_t back = tail.load(memory_order_relaxed);
+    if (back - head.load(memory_order_acquire) == CAPACITY)
     {
-        cout << "Not enough points or gold to place Lion!" << endl;
+        return false;
     }
+    slots[back % CAPACITY] = migration;
+    tail.store(back + 1, memory_order_release);
+    return true;
 }
-void Lion::applyEffect(Player& player)
+bool MigrationQueue::pop(Migration& migration)
 {
-    if (!player.hasSword())
+    size_t front = head.load(memory_order_relaxed);
+    if (front == tail.load(memory_order_acquire))
     {
-        player.block(getBlockTurns());
-        player.deductPoints(getPenalty());
-        cout << "Blocked by Lion! -50 points, wait 4 turns." << endl;
-    }
-    else
-    {
-        player.useSword();
+        return false;
     }
+    migration = slots[front % CAPACITY];
+    head.store(front + 1, memory_order_release);
+    return true;
 }
-Item* Lion::clone() const
+struct alignas(64) WorldRegion
 {
-    return new Lion(*this);
-}
-Lock::Lock(int x, int y) : Hurdle(x, y, 60, 0, 99)
+    Board board;
+    unique_ptr<Player*[]> residents;
+    int residentCount;
+    unique_ptr<Player*[]> arrivals;
+    int arrivalCount;
+    uint8_t occupancy[11 * 11 + 1];
+    int goalNumber;
+    int entries;
+    uint64_t generation;
+
+    WorldRegion(int level, uint64_t seed, int population);
+    WorldRegion(const WorldRegion&) = delete;
+    WorldRegion& operator=(const WorldRegion&) = delete;
+};
+WorldRegion::WorldRegion(int level, uint64_t seed, int population) : board(level, seed), residentCount(0), arrivalCount(0), occupancy(), entries(0), generation(0)
 {
-    name = "Lock";
+    int totalCells = board.getSize() * board.getSize();
+    goalNumber = (totalCells + 1) / 2;
+    residents = make_unique<Player*[]>(totalCells);
+    arrivals = make_unique<Player*[]>(population);
 }
-void Lock::interact(Player& player)
+struct ShardStats
+{
+    int regions = 0;
+    long long ticks = 0;
+    long long turns = 0;
+    long long residentTicks = 0;
+    long long localMigrations = 0;
+    long long sentMigrations = 0;
+    long long receivedMigrations = 0;
+    long long queueFull = 0;
+    long long respawns = 0;
+    double seconds = 0;
+};
+struct alignas(64) WorldShard
+{
+    unique_ptr<Migration[]> outbox;
+    int outboxSize = 0;
+    ShardStats stats;
+};
+class World
+{
+private:
+    int regionCount;
+    int shardCount;
+    int population;
+    int level;
+    uint64_t seed;
+    unique_ptr<Player[]> players;
+    unique_ptr<unique_ptr<WorldRegion>[]> regions;
+    unique_ptr<MigrationQueue[]> queues;
+    unique_ptr<WorldShard[]> shards;
+    atomic<bool> stopping;
+
+    int ownerOf(int region) const { return region % shardCount; }
+    MigrationQueue& queue(int from, int to) { return queues[from * shardCount + to]; }
+    void arrive(const Migration& migration) { WorldRegion& region = *regions[migration.region]; region.arrivals[region.arrivalCount++] = migration.player; }
+    void admit(WorldRegion& region);
+    void depart(int shard, int from, Player* player);
+    void stepRegion(int shard, int index);
+    void runShard(int shard);
+
+public:
+    World(int boardCount, int shardCount, int playersPerBoard, int level, uint64_t seed);
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+    void run(double seconds);
+    long long collectInFlight();
+    int getShardCount() const { return shardCount; }
+    int getBoardCount() const { return regionCount; }
+    int getPopulation() const { return population; }
+    const ShardStats& getStats(int shard) const { return shards[shard].stats; }
+    long long residentsOn(int shard) const;
+};
+World::World(int boardCount, int shardCount, int playersPerBoard, int level, uint64_t seed) : regionCount(boardCount), shardCount(max(1, min(shardCount, boardCount))), population(0), level(level), seed(seed), stopping(false)
 {
-    if (player.getSilver() >= 12)
+    int totalCells = Board(level, seed).getSize();
+    totalCells *= totalCells;
+    int perBoard = min(playersPerBoard, AdventureQuest::maxPlayersFor(totalCells));
+    population = perBoard * regionCount;
+    queues = make_unique<MigrationQueue[]>(static_cast<size_t>(this->shardCount) * this->shardCount);
+    shards = make_unique<WorldShard[]>(this->shardCount);
+    for (int shard = 0; shard < this->shardCount; ++shard)
     {
-        player.deductSilver(12);
-        player.placeHurdle(this->clone());
+        shards[shard].outbox = make_unique<Migration[]>(population);
     }
-    else
+    players.reset(new Player[population]);
+    regions = make_unique<unique_ptr<WorldRegion>[]>(regionCount);
+    for (int r = 0; r < regionCount; ++r)
     {
-        cout << "Not enough silver to place Lock!" << endl;
+        regions[r] = make_unique<WorldRegion>(level, Rng::mix(seed, static_cast<uint64_t>(r)), population);
+        WorldRegion& region = *regions[r];
+        for (int seat = 0; seat < perBoard; ++seat)
+        {
+            Player* player = &players[r * perBoard + seat];
+            *player = Player(r * perBoard + seat, AdventureQuest::startCell(seat, perBoard, totalCells), AdventureQuest::startDirection(seat), &region.board, level);
+            player->history.reserve(totalCells);
+            region.residents[region.residentCount++] = player;
+            region.occupancy[player->getCurrentNumber()]++;
+        }
+        shards[ownerOf(r)].stats.regions++;
     }
 }
-void Lock::applyEffect(Player& player)
+void World::admit(WorldRegion& region)
 {
-    if (!player.hasKey())
-    {
-        player.block(getBlockTurns());
-        cout << "Blocked by Lock! Need a key to proceed." << endl;
-    }
-    else
+    int totalCells = region.board.getSize() * region.board.getSize();
+    int kept = 0;
+    for (int a = 0; a < region.arrivalCount; ++a)
     {
-        player.useKey();
+        Player* player = region.arrivals[a];
+        int side = region.entries % 2;
+        int cell = AdventureQuest::startCell(side, 2, totalCells);
+        if (region.occupancy[cell] > 0)
+        {
+            side = 1 - side;
+            cell = AdventureQuest::startCell(side, 2, totalCells);
+        }
+        if (region.occupancy[cell] > 0 || region.residentCount == totalCells)
+        {
+            region.arrivals[kept++] = player;
+            continue;
+        }
+        region.entries++;
+        player->enterBoard(&region.board, cell, AdventureQuest::startDirection(side));
+        region.occupancy[cell]++;
+        region.residents[region.residentCount++] = player;
     }
+    region.arrivalCount = kept;
 }
-Item* Lock::clone() const
-{
-    return new Lock(*this);
-}
-AdventureQuest::AdventureQuest() : currentLevel(1), player1ReachedFirst(false), player2ReachedFirst(false)
-{
-    board = new Board(currentLevel);
-    int totalCells = board->getSize() * board->getSize();
-    player1 = new Player(totalCells, board, currentLevel);
-    player2 = new Player(1, board, currentLevel);
-    goalNumber = (totalCells + 1) / 2;
-    savedState = nullptr;
-}
-AdventureQuest::AdventureQuest(const AdventureQuest& other) : currentLevel(other.currentLevel), goalNumber(other.goalNumber), player1ReachedFirst(other.player1ReachedFirst), player2ReachedFirst(other.player2ReachedFirst)
-{
-    board = new Board(*other.board);
-    player1 = new Player(*other.player1);
-    player2 = new Player(*other.player2);
-    player1->board = board;
-    player2->board = board;
-    savedState = nullptr;
-}
-AdventureQuest& AdventureQuest::operator=(const AdventureQuest& other)
+void World::depart(int shard, int from, Player* player)
 {
-    if (this != &other)
+    uint64_t route = Rng::mix(Rng::mix(seed, static_cast<uint64_t>(from)), static_cast<uint64_t>(player->getSeat()) << 32 | static_cast<uint32_t>(regions[from]->entries));
+    Migration migration = { player, static_cast<int>(route % static_cast<uint64_t>(regionCount)) };
+    int owner = ownerOf(migration.region);
+    WorldShard& state = shards[shard];
+    if (owner == shard)
     {
-        delete board;
-        delete player1;
-        delete player2;
-        delete savedState;
-
-        board = new Board(*other.board);
-        player1 = new Player(*other.player1);
-        player2 = new Player(*other.player2);
-        player1->board = board;
-        player2->board = board;
-        savedState = nullptr;
-        currentLevel = other.currentLevel;
-        goalNumber = other.goalNumber;
-        player1ReachedFirst = other.player1ReachedFirst;
-        player2ReachedFirst = other.player2ReachedFirst;
+        arrive(migration);
+        state.stats.localMigrations++;
     }
-    return *this;
-}
-AdventureQuest::~AdventureQuest()
-{
-    delete board;
-    delete player1;
-    delete player2;
-    delete savedState;
-}
-void AdventureQuest::saveGame()
-{
-    delete savedState;
-    savedState = new AdventureQuest(*this);
-    cout << "Game state saved!" << endl;
-}
-void AdventureQuest::loadGame()
-{
-    if (savedState) {
-        AdventureQuest* temp = new AdventureQuest(*savedState);
-        *this = *temp;
-        delete temp;
-        cout << "Game state loaded!" << endl;
+    else if (state.outboxSize == 0 && queue(shard, owner).push(migration))
+    {
+        state.stats.sentMigrations++;
     }
     else
     {
-        cout << "No saved game available!" << endl;
+        state.outbox[state.outboxSize++] = migration;
+        state.stats.queueFull++;
     }
 }
-void AdventureQuest::playTurn(Player* player, Player* opponent, bool isPlayer1)
+void World::stepRegion(int shard, int index)
 {
-    cout << endl;
-    cout << (isPlayer1 ? "Player 1" : "Player 2") << "'s turn:" << endl;
-    player->printStatus();
-    board->print(player1, player2);
-
-    if (player->isBlocked())
-    {
-        cout << (isPlayer1 ? "Player 1" : "Player 2") << " is blocked for " << player->blockedTurns << " more turns!" << endl;
-        player->unblock();
-        return;
-    }
-
-    if (player->hasReachedGoalState())
-    {
-        cout << "Player has reached the goal and is waiting." << endl;
-        return;
-    }
-
-    int choice;
-    cout << "1. Move" << endl;
-    cout << "2. Place Hurdle" << endl;
-    cout << "3. Buy Helper" << endl;
-    cout << "4. Use Item" << endl;
-    cout << "Choice: ";
-    cin >> choice;
-
-    if (choice == 1)
+    WorldRegion& region = *regions[index];
+    ShardStats& stats = shards[shard].stats;
+    admit(region);
+    Board& board = region.board;
+    int totalCells = board.getSize() * board.getSize();
+    int kept = 0;
+    for (int r = 0; r < region.residentCount; ++r)
     {
-        int nextNum;
-        if (isPlayer1)
+        Player* player = region.residents[r];
+        stats.turns++;
+        if (player->isBlocked())
         {
-            nextNum = player->getCurrentNumber() - 1;
+            player->unblock();
+            region.residents[kept++] = player;
+            continue;
         }
-        else
+        int nextNum = player->getCurrentNumber() + player->getDirection();
+        if (nextNum < 1 || nextNum > totalCells || isCellOccupied(region.occupancy, nextNum, region.goalNumber))
         {
-            nextNum = player->getCurrentNumber() + 1;
+            region.residents[kept++] = player;
+            continue;
         }
-
-        if (nextNum < 1 || nextNum > board->getSize() * board->getSize())
+        ItemKind kind = board.getKind(nextNum);
+        movePlayer(*player, board, region.occupancy, region.goalNumber);
+        if (Board::prototype(kind) && !isHurdleKind(kind) && board.coinValueBetween(1, totalCells) == 0)
         {
-            cout << "Cannot move further!" << endl;
-            return;
+            board.reset(level, Rng::mix(board.getSeed(), ++region.generation));
+            stats.respawns++;
         }
-
-        auto pos = board->numberToPosition(nextNum);
-        if (pos.first == opponent->getX() && pos.second == opponent->getY() && nextNum != goalNumber)
+        if (player->getCurrentNumber() == region.goalNumber)
         {
-            cout << "Cell occupied by opponent! Wait for your next turn." << endl;
-            return;
+            region.occupancy[region.goalNumber]--;
+            depart(shard, index, player);
+            continue;
         }
-
-        player->setPosition(nextNum);
-
-        Item* item = board->getItem(pos.first, pos.second);
-        if (item)
+        region.residents[kept++] = player;
+    }
+    region.residentCount = kept;
+    stats.residentTicks += kept + region.arrivalCount;
+}
+void World::runShard(int shard)
+{
+    AQ_TRACE_SPAN("World::runShard");
+    bool wasQuiet = GameLog::isQuiet();
+    GameLog::setQuiet(true);
+    auto started = chrono::steady_clock::now();
+    Migration* outbox = shards[shard].outbox.get();
+    int& outboxSize = shards[shard].outboxSize;
+    ShardStats& stats = shards[shard].stats;
+    while (!stopping.load(memory_order_relaxed))
+    {
+        stats.ticks++;
+        for (int from = 0; from < shardCount; ++from)
         {
-            if (Hurdle* hurdle = dynamic_cast<Hurdle*>(item))
-            {
-                hurdle->applyEffect(*player);
-            }
-            else
+            Migration migration;
+            while (from != shard && queue(from, shard).pop(migration))
             {
-                item->interact(*player);
-                board->setItem(pos.first, pos.second, nullptr);
-                delete item;
+                arrive(migration);
+                stats.receivedMigrations++;
             }
         }
-
-        if (nextNum == goalNumber)
+        int sent = 0;
+        while (sent < outboxSize && queue(shard, ownerOf(outbox[sent].region)).push(outbox[sent]))
         {
-            player->setReachedGoal(true);
-            if (isPlayer1) {
-                player1ReachedFirst = true;
-            }
-            else
-            {
-                player2ReachedFirst = true;
-            }
-            cout << (isPlayer1 ? "Player 1" : "Player 2") << " has reached the goal (cell " << goalNumber << ")!" << endl;
+            sent++;
         }
-    }
-    else if (choice == 2)
-    {
-        int hurdleChoice;
-        cout << "Select hurdle to place:" << endl;
-        cout << "1. Fire (50 pts)" << endl;
-        cout << "2. Snake (30 pts)" << endl;
-        cout << "3. Ghost (20 pts)" << endl;
-        cout << "4. Lion (50 pts + 1 gold)" << endl;
-        cout << "5. Lock (12 silver)" << endl;
-        cout << "Choice: ";
-        cin >> hurdleChoice;
-
-        Hurdle* newHurdle = nullptr;
-        switch (hurdleChoice) {
-        case 1: newHurdle = new Fire(player->getX(), player->getY()); break;
-        case 2: newHurdle = new Snake(player->getX(), player->getY()); break;
-        case 3: newHurdle = new Ghost(player->getX(), player->getY()); break;
-        case 4: newHurdle = new Lion(player->getX(), player->getY()); break;
-        case 5: newHurdle = new Lock(player->getX(), player->getY()); break;
-        default: cout << "Invalid choice!" << endl; return;
+        stats.sentMigrations += sent;
+        outboxSize -= sent;
+        memmove(outbox, outbox + sent, outboxSize * sizeof(Migration));
+        long long turnsBefore = stats.turns;
+        for (int r = shard; r < regionCount; r += shardCount)
+        {
+            stepRegion(shard, r);
+        }
+        if (stats.turns == turnsBefore)
+        {
+            this_thread::yield();
         }
-        newHurdle->interact(*player);
     }
-    else if (choice == 3)
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    GameLog::setQuiet(wasQuiet);
+}
+void World::run(double seconds)
+{
+    stopping.store(false);
+    thread* pool = new thread[shardCount];
+    for (int shard = 0; shard < shardCount; ++shard)
     {
-        int helperChoice;
-        cout << "Select helper to buy:" << endl;
-        cout << "1. Sword (40 pts)" << endl;
-        cout << "2. Shield (30 pts)" << endl;
-        cout << "3. Water (50 pts)" << endl;
-        cout << "4. Key (12 silver)" << endl;
-        cout << "Choice: ";
-        cin >> helperChoice;
-
-        Helper* newHelper = nullptr;
-        switch (helperChoice) {
-        case 1: newHelper = new Sword(player->getX(), player->getY()); break;
-        case 2: newHelper = new Shield(player->getX(), player->getY()); break;
-        case 3: newHelper = new Water(player->getX(), player->getY()); break;
-        case 4: newHelper = new Key(player->getX(), player->getY()); break;
-        default: cout << "Invalid choice!" << endl; return;
-        }
-        newHelper->interact(*player);
-        delete newHelper;
+        pool[shard] = thread(&World::runShard, this, shard);
     }
-    else if (choice == 4)
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stopping.store(true);
+    for (int shard = 0; shard < shardCount; ++shard)
     {
-        player->displayInventory();
-        if (player->invSize == 0)
-        {
-            return;
-        }
-        cout << "Select item to use (1-" << player->invSize << "): ";
-        int itemChoice;
-        cin >> itemChoice;
-        player->useItem(itemChoice - 1);
+        pool[shard].join();
     }
+    delete[] pool;
 }
-void AdventureQuest::startGame()
+long long World::collectInFlight()
 {
-    player1ReachedFirst = false;
-    player2ReachedFirst = false;
-
-    while (!(player1->hasReachedGoalState() && player2->hasReachedGoalState()))
+    long long count = 0;
+    for (int from = 0; from < shardCount; ++from)
     {
-        cout << endl;
-        cout << "P1: ";
-        playTurn(player1, player2, true);
-
-        cout << endl;
-        cout << "P2: ";
-        playTurn(player2, player1, false);
-
-        if (player1->hasReachedGoalState() && player2->hasReachedGoalState())
-        {
-            determineWinner();
-            break;
-        }
-
-        cout << endl;
-        cout << "1. Continue" << endl;
-        cout << "2. Save" << endl;
-        cout << "3. Load" << endl;
-        cout << "Choice: ";
-        int choice;
-        cin >> choice;
-        if (choice == 2)
+        Migration migration;
+        for (int to = 0; to < shardCount; ++to)
         {
-            saveGame();
+            while (queue(from, to).pop(migration))
+            {
+                arrive(migration);
+                count++;
+            }
         }
-        else if (choice == 3)
+        for (int m = 0; m < shards[from].outboxSize; ++m)
         {
-            loadGame();
+            arrive(shards[from].outbox[m]);
+            count++;
         }
+        shards[from].outboxSize = 0;
     }
+    return count;
 }
-void AdventureQuest::determineWinner()
+long long World::residentsOn(int shard) const
 {
-    cout << endl;
-    cout << "Game Over!" << endl;
-    cout << "Player 1 Points: " << player1->getPoints() << endl;
-    cout << "Player 2 Points: " << player2->getPoints() << endl;
-
-    bool p1ReachedFirst = player1ReachedFirst;
-    bool p2ReachedFirst = player2ReachedFirst;
-    int p1Points = player1->getPoints();
-    int p2Points = player2->getPoints();
-
-    if (p1ReachedFirst && p1Points > p2Points)
+    long long count = 0;
+    for (int r = shard; r < regionCount; r += shardCount)
     {
-        cout << "Player 1 wins!" << endl;
+        count += regions[r]->residentCount + regions[r]->arrivalCount;
     }
-    else if (p2ReachedFirst && p2Points > p1Points)
+    return count;
+}
+int runWorld(int argc, char* argv[])
+{
+    bool valid = true;
+    int boards = readNumber<int>(argc, argv, "--boards", "256", valid);
+    int threads = readNumber<int>(argc, argv, "--threads", to_string(max(1u, thread::hardware_concurrency())), valid);
+    int playersPerBoard = readNumber<int>(argc, argv, "--players", "4", valid);
+    double duration = readNumber<double>(argc, argv, "--seconds", "1", valid);
+    int level = max(1, min(4, readNumber<int>(argc, argv, "--level", "2", valid)));
+    uint64_t seed = readNumber<uint64_t>(argc, argv, "--seed", "1", valid);
+    if (!valid)
     {
-        cout << "Player 2 wins!" << endl;
+        return 1;
     }
-    else
+    if (boards < 1 || threads < 1 || playersPerBoard < 1 || duration < 0)
+    {
+        cout << "Boards, threads and players must be positive!" << endl;
+        return 1;
+    }
+
+    World world(boards, threads, playersPerBoard, level, seed);
+    auto started = chrono::steady_clock::now();
+    world.run(duration);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    long long inFlight = world.collectInFlight();
+
+    int shards = world.getShardCount();
+    cout << "World of " << world.getBoardCount() << " boards on " << shards << " shards, " << world.getPopulation() << " players, ran " << fixed << setprecision(2) << seconds << " s" << endl;
+    cout << left << setw(7) << "Shard" << setw(8) << "Boards" << setw(9) << "Players" << setw(10) << "Ticks" << setw(10) << "Avg load" << setw(12) << "Turns" << setw(12) << "Turns/s" << setw(9) << "Local" << setw(9) << "Sent" << setw(10) << "Received" << setw(8) << "Stalls" << "Respawns" << endl;
+    ShardStats total;
+    long long population = 0;
+    for (int shard = 0; shard < shards; ++shard)
+    {
+        const ShardStats& shardStats = world.getStats(shard);
+        long long residents = world.residentsOn(shard);
+        population += residents;
+        cout << setw(7) << shard << setw(8) << shardStats.regions << setw(9) << residents << setw(10) << shardStats.ticks << setw(10) << setprecision(1) << (shardStats.ticks > 0 ? static_cast<double>(shardStats.residentTicks) / shardStats.ticks : 0.0);
+        cout << setw(12) << shardStats.turns << setw(12) << setprecision(0) << (shardStats.seconds > 0 ? shardStats.turns / shardStats.seconds : 0.0);
+        cout << setw(9) << shardStats.localMigrations << setw(9) << shardStats.sentMigrations << setw(10) << shardStats.receivedMigrations << setw(8) << shardStats.queueFull << shardStats.respawns << endl;
+        total.turns += shardStats.turns;
+        total.localMigrations += shardStats.localMigrations;
+        total.sentMigrations += shardStats.sentMigrations;
+    }
+    cout << right;
+    cout << "Total: " << total.turns << " turns (" << setprecision(0) << (seconds > 0 ? total.turns / seconds : 0.0) << " turns/s), " << total.localMigrations + total.sentMigrations << " migrations, " << total.sentMigrations << " across shards, " << inFlight << " in flight at stop" << endl;
+    if (population != world.getPopulation())
     {
-        cout << "It's a draw!" << endl;
+        cout << "Population changed from " << world.getPopulation() << " to " << population << "!" << endl;
+        return 1;
     }
+    return 0;
 }
-void AdventureQuest::levelUp()
+#if !defined(AQ_FUZZER) && !defined(AQ_BUILD_LIBRARY)
+int main(int argc, char* argv[])
 {
-    if (currentLevel >= 4)
+#ifdef AQ_TRACING
+    TraceSession trace(readOption(argc, argv, "--trace", ""));
+#else
+    if (!readOption(argc, argv, "--trace", "").empty())
     {
-        cout << "Maximum level reached!" << endl;
-        return;
+        cerr << "Tracing is not compiled in; rebuild with -DAQ_TRACING." << endl;
+    }
+#endif
+    if (argc > 1 && string(argv[1]) == "--analytics")
+    {
+        return runAnalytics(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--campaign")
+    {
+        return runCampaign(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--pack-boards")
+    {
+        return runPackBoards(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--record")
+    {
+        return runRecord(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--replay")
+    {
+        return runReplay(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--env")
+    {
+        return runEnvBenchmark(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--batch")
+    {
+        return runBatchBenchmark(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--sweep")
+    {
+        return runSweep(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--fuzz")
+    {
+        return runFuzz(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--evolve")
+    {
+        return runEvolve(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--spectate")
+    {
+        return runSpectator(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--world")
+    {
+        return runWorld(argc, argv);
     }
 
-    currentLevel++;
-    delete board;
-    board = new Board(currentLevel);
-
-    int totalCells = board->getSize() * board->getSize();
-    goalNumber = (totalCells + 1) / 2;
-
-    player1->levelUp(totalCells);
-    player2->levelUp(1);
-
-    cout << "Level Up! Now playing on " << board->getSize() << "x" << board->getSize() << " board!" << endl;
-}
-int main()
-{
+    bool valid = true;
+    int playerCount = readNumber<int>(argc, argv, "--players", "2", valid);
+    if (!valid)
+    {
+        return 1;
+    }
+    StatePublisher publisher;
+    if (!openPublisher(argc, argv, publisher))
+    {
+        return 1;
+    }
     int choice;
-    AdventureQuest* game = nullptr;
+    unique_ptr<AdventureQuest> game;
 
     while (true)
     {
@@ -1647,12 +7744,12 @@ int main()
         cout << "2. Load Game" << endl;
         cout << "3. Exit" << endl;
         cout << "Choice: ";
-        cin >> choice;
+        readInput(choice);
 
         if (choice == 1)
         {
-            delete game;
-            game = new AdventureQuest();
+            game = make_unique<AdventureQuest>(1, static_cast<uint64_t>(time(0)), playerCount);
+            game->setPublisher(publisher.isOpen() ? &publisher : nullptr);
             while (game->getBoardLevel() <= 4)
             {
                 game->startGame();
@@ -1664,23 +7761,17 @@ int main()
                 cout << "1. Next Level" << endl;
                 cout << "2. Exit" << endl;
                 cout << "Choice: ";
-                cin >> choice;
+                readInput(choice);
                 if (choice == 1)
                 {
                     game->levelUp();
                 }
                 else
                 {
-                    delete game;
-                    game = nullptr;
                     break;
                 }
             }
-            if (game)
-            {
-                delete game;
-                game = nullptr;
-            }
+            game.reset();
         }
         else if (choice == 2)
         {
@@ -1692,13 +7783,13 @@ int main()
             else
             {
                 cout << "No saved game found! Starting new game..." << endl;
-                game = new AdventureQuest();
+                game = make_unique<AdventureQuest>(1, static_cast<uint64_t>(time(0)), playerCount);
+                game->setPublisher(publisher.isOpen() ? &publisher : nullptr);
                 game->startGame();
             }
         }
         else if (choice == 3)
         {
-            delete game;
             cout << "Thanks for playing!" << endl;
             break;
         }
@@ -1710,3 +7801,4 @@ int main()
 
     return 0;
 }
+#endif